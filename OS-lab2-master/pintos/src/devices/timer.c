@@ -1,6 +1,7 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
@@ -17,6 +18,13 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* PIT cycles in one timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest idle countdown, in ticks, that fits in the PIT's
+   16-bit counter. */
+#define COUNTDOWN_MAX_TICKS (65535 / TICK_CYCLES)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
@@ -24,7 +32,33 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads blocked in timer_sleep(), in ascending order of
+   wakeup_time.  Threads with equal wakeup times stay in the
+   order in which they went to sleep. */
+static struct list sleep_list;
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+   second at all times.
+   If true, the periodic tick is replaced by a one-shot countdown
+   to the next sleeper's wakeup while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Idle countdown state.  See timer_idle_enter(). */
+static int64_t countdown_ticks;     /* Ticks covered, 0 if not armed. */
+static uint32_t countdown_cycles;   /* PIT cycles programmed. */
+static uint32_t countdown_phase;    /* Cycles of the tick already gone. */
+static uint32_t residual_cycles;    /* Uncounted cycles from early stops. */
+
+/* Statistics. */
+static long long skipped_ticks;     /* # of ticks that passed silently. */
+static long long countdown_cnt;     /* # of idle countdowns armed. */
+
 static intr_handler_func timer_interrupt;
+static bool wakeup_less (const struct list_elem *, const struct list_elem *,
+                         void *aux);
+static void wake_sleepers (void);
+static void stop_countdown (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,6 +69,7 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -89,15 +124,17 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
-  ASSERT (intr_get_level () == INTR_ON);
-  if (ticks <= 0) return;
-
   struct thread *cur = thread_current ();
-  enum intr_level old_level = intr_disable ();
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
 
+  old_level = intr_disable ();
   cur->wakeup_time = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
   thread_block ();
-
   intr_set_level (old_level);
 }
 
@@ -169,15 +206,148 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %lld ticks skipped while idle, %lld idle countdowns\n",
+            skipped_ticks, countdown_cnt);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If tickless idle is enabled, replaces the
+   periodic tick by a single countdown that ends at the next
+   sleeper's wakeup time, or as far in the future as the PIT
+   allows if nobody is asleep, so that the CPU is not woken up
+   by ticks that have nothing to do.
+
+   The countdown is stopped either by its own interrupt or, if
+   some other interrupt makes a thread ready first, by
+   timer_idle_exit() when the scheduler switches away from the
+   idle thread. */
+void
+timer_idle_enter (void) 
+{
+  int64_t span = COUNTDOWN_MAX_TICKS;
+  uint16_t remaining;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || countdown_ticks != 0)
+    return;
+
+  /* Don't sleep past the first wakeup. */
+  if (!list_empty (&sleep_list)) 
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_time - ticks < span)
+        span = t->wakeup_time - ticks;
+    }
+
+  /* The multi-level feedback queue scheduler needs to see the
+     tick that starts each second. */
+  if (thread_mlfqs && TIMER_FREQ - ticks % TIMER_FREQ < span)
+    span = TIMER_FREQ - ticks % TIMER_FREQ;
+
+  if (span < 2)
+    return;
+
+  /* Part of the current tick has already gone by.  End the
+     countdown on a tick boundary anyway, so that the periodic
+     tick resumes in phase with the ticks already counted. */
+  remaining = pit_read_counter (0);
+  countdown_ticks = span;
+  countdown_phase = TICK_CYCLES - remaining;
+  countdown_cycles = remaining + (span - 1) * TICK_CYCLES;
+  countdown_cnt++;
+  pit_start_countdown (0, countdown_cycles);
+}
+
+/* Stops the idle countdown armed by timer_idle_enter(), if any,
+   and restores the periodic tick.  Must be called with
+   interrupts off. */
+void
+timer_idle_exit (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (countdown_ticks != 0)
+    stop_countdown ();
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  int64_t now = ++ticks;
+  if (countdown_ticks != 0)
+    stop_countdown ();
+  ticks++;
   thread_tick ();
-  thread_foreach(update_sleeping_threads, &now);
+  wake_sleepers ();
+}
+
+/* Returns true if sleeping thread A wakes up before sleeping
+   thread B, false otherwise. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_time < b->wakeup_time;
+}
+
+/* Unblocks every thread at the front of sleep_list whose wakeup
+   time has arrived.  Because the list is ordered, this touches
+   only the threads that actually wake up, plus one. */
+static void
+wake_sleepers (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_time > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
+}
+
+/* Credits the ticks that passed during the idle countdown and
+   goes back to periodic interrupts. */
+static void
+stop_countdown (void) 
+{
+  uint16_t count = pit_read_counter (0);
+  int64_t credit;
+
+  if (count != 0 && count <= countdown_cycles)
+    {
+      /* Stopped before running out.  Credit the whole ticks that
+         passed and carry the partial one over to the next stop,
+         so that early wakeups don't make the clock drift.  Never
+         credit the countdown's final tick, which must be seen by
+         the interrupt handler so that sleepers wake up on time. */
+      uint32_t elapsed = (countdown_phase + (countdown_cycles - count)
+                          + residual_cycles);
+      credit = elapsed / TICK_CYCLES;
+      if (credit > countdown_ticks - 1)
+        credit = countdown_ticks - 1;
+      residual_cycles = elapsed - credit * TICK_CYCLES;
+    }
+  else
+    {
+      /* Ran out.  Its interrupt, whether being handled right now
+         or still pending, accounts for the final tick. */
+      credit = countdown_ticks - 1;
+    }
+
+  ticks += credit;
+  skipped_ticks += credit;
+  countdown_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
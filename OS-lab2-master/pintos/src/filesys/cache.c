@@ -0,0 +1,470 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache.
+
+   Caches up to CACHE_CNT sectors of the file system device, so
+   that repeated reads and writes of the same sector, and writes
+   of part of a sector, do not each go to the device.  Written
+   sectors are marked dirty and written back only when they are
+   evicted, when the flush thread runs, or when the file system
+   is shut down.
+
+   Before any dirty sector is written back, free_map_flush()
+   writes the free map's changes to the device, so that an inode
+   or index block never reaches the disk ahead of the record that
+   the sectors it points to are in use.
+
+   Cached sectors are found through a hash table, since small
+   reads and writes look up a sector for every few bytes they
+   transfer.
+
+   Eviction uses the clock algorithm: a hand sweeps over the
+   entries, clearing their accessed bits, and evicts the first
+   entry whose accessed bit was already clear.
+
+   Sectors can also be read ahead: cache_read_ahead() queues a
+   sector, and a read-ahead thread loads it into the cache in
+   the background, so that a later cache_read() finds it there.
+
+   Synchronization is in two levels, so that no lock on the
+   whole cache is held across device I/O.  cache_lock protects
+   the hash table, the clock hand, the statistics, and each
+   entry's sector, valid, accessed, read_ahead and pin_cnt
+   members.  Each entry's own lock protects its data and dirty
+   bit, and is held across I/O on the entry.  A thread pins an
+   entry, while holding cache_lock, before it acquires the
+   entry's lock, and eviction passes over pinned entries, so an
+   entry is never reused for another sector while in use.
+   Threads using different sectors thus proceed in parallel,
+   and threads using the same sector wait only for each other. */
+
+/* Number of cached sectors. */
+#define CACHE_CNT 64
+
+/* Ticks between writes of dirty sectors by the flush thread. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Maximum number of queued read-ahead requests.  Requests made
+   while the queue is full are dropped. */
+#define READ_AHEAD_CNT 32
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    struct hash_elem elem;              /* Element in cache_table. */
+    block_sector_t sector;              /* Sector held, if valid. */
+    bool valid;                         /* True if in use. */
+    bool accessed;                      /* Used since the hand passed? */
+    bool read_ahead;                    /* Read ahead and not used yet? */
+    int pin_cnt;                        /* Number of threads using it. */
+
+    /* Protected by LOCK. */
+    struct lock lock;                   /* Held while using the data. */
+    bool dirty;                         /* True if newer than disk. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_CNT];
+static struct hash cache_table;         /* Valid entries, by sector. */
+static struct lock cache_lock;          /* Protects the cache. */
+static size_t clock_hand;               /* Next entry to consider. */
+
+/* Read-ahead requests, a circular queue of sectors. */
+static block_sector_t read_ahead_queue[READ_AHEAD_CNT];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of requests. */
+static struct lock read_ahead_lock;     /* Protects the queue. */
+static struct condition read_ahead_ready; /* Signaled on new requests. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Accesses to cached sectors. */
+static long long miss_cnt;              /* Accesses that read the device. */
+static long long read_ahead_read_cnt;   /* Sectors read ahead. */
+static long long read_ahead_hit_cnt;    /* ...later used by an access. */
+static long long read_ahead_waste_cnt;  /* ...evicted before any use. */
+
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *evict (void);
+static void write_back (struct cache_entry *);
+static struct cache_entry *get_entry (block_sector_t, bool read_ahead,
+                                      bool *newp);
+static void put_entry (struct cache_entry *);
+static void flush_thread (void *aux) NO_RETURN;
+static void read_ahead_thread (void *aux) NO_RETURN;
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Initializes the buffer cache and starts its flush and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&cache_table, entry_hash, entry_less, NULL))
+    PANIC ("buffer cache creation failed");
+  for (i = 0; i < CACHE_CNT; i++)
+    lock_init (&cache[i].lock);
+  lock_init (&cache_lock);
+  lock_profile (&cache_lock, "buffer cache");
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_ready);
+  thread_create ("cache-flush", PRI_DEFAULT, flush_thread, NULL);
+  thread_create ("cache-readahead", PRI_DEFAULT, read_ahead_thread, NULL);
+}
+
+/* Reads SIZE bytes into BUFFER from SECTOR of the file system
+   device, starting SECTOR_OFS bytes into the sector. */
+void
+cache_read (block_sector_t sector, void *buffer, int sector_ofs, int size)
+{
+  struct cache_entry *e;
+  bool new;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, false, &new);
+  if (new)
+    block_read (fs_device, sector, e->data);
+  memcpy (buffer, e->data + sector_ofs, size);
+  put_entry (e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR of the file system
+   device, starting SECTOR_OFS bytes into the sector.  The write
+   reaches the device later, when the sector is written back. */
+void
+cache_write (block_sector_t sector, const void *buffer, int sector_ofs,
+             int size)
+{
+  struct cache_entry *e;
+  bool new;
+
+  ASSERT (sector_ofs >= 0 && size >= 0);
+  ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, false, &new);
+  /* A write of the whole sector need not read it first. */
+  if (new && size < BLOCK_SECTOR_SIZE)
+    block_read (fs_device, sector, e->data);
+  memcpy (e->data + sector_ofs, buffer, size);
+  e->dirty = true;
+  put_entry (e);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR of the
+   file system device right away, and into the cache too if
+   SECTOR is cached there.  Unlike cache_write(), never evicts
+   an entry, so eviction may call it through free_map_flush().
+   The caller must keep SECTOR from being read into the cache
+   meanwhile. */
+void
+cache_write_through (block_sector_t sector, const void *buffer)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      lock_release (&cache_lock);
+      block_write (fs_device, sector, buffer);
+      return;
+    }
+  e->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+  block_write (fs_device, sector, e->data);
+  e->dirty = false;
+  put_entry (e);
+}
+
+/* Writes every dirty sector in the cache to the device, after
+   the free map. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  free_map_flush ();
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].valid)
+      write_back (&cache[i]);
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be loaded into the cache in the background,
+   in anticipation of a read.  Does nothing if too many requests
+   are already queued. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_CNT)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt++) % READ_AHEAD_CNT;
+      read_ahead_queue[tail] = sector;
+      cond_signal (&read_ahead_ready, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %lld hits, %lld misses; "
+          "read ahead %lld sectors, %lld used, %lld wasted\n",
+          hit_cnt, miss_cnt, read_ahead_read_cnt, read_ahead_hit_cnt,
+          read_ahead_waste_cnt);
+}
+
+/* Returns the cache entry for SECTOR, pinned and with its lock
+   held, reusing another entry for it if SECTOR is not cached.
+   In that case, sets *NEWP to true, and the caller must fill in
+   the entry's data; otherwise, sets *NEWP to false.  Unless
+   READ_AHEAD is true, counts the access in the statistics and
+   marks the entry accessed.  Release the entry with
+   put_entry().
+
+   The cache lock must be held on entry.  It is released on
+   return. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool read_ahead, bool *newp)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          *newp = false;
+          if (!read_ahead)
+            {
+              hit_cnt++;
+              if (e->read_ahead)
+                {
+                  read_ahead_hit_cnt++;
+                  e->read_ahead = false;
+                }
+              e->accessed = true;
+            }
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      /* Eviction may have to release the cache lock, in which
+         case another thread may have cached SECTOR meanwhile, so
+         look again. */
+      e = evict ();
+      if (e != NULL)
+        break;
+    }
+
+  *newp = true;
+  if (read_ahead)
+    read_ahead_read_cnt++;
+  else
+    miss_cnt++;
+  e->sector = sector;
+  hash_insert (&cache_table, &e->elem);
+  e->valid = true;
+  e->accessed = true;
+  e->read_ahead = read_ahead;
+  e->dirty = false;
+  e->pin_cnt = 1;
+
+  /* No other thread has E pinned, so this cannot block.  Taking
+     the entry's lock before releasing the cache lock keeps other
+     threads from using E until its data is filled in. */
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+  return e;
+}
+
+/* Releases entry E, obtained from get_entry(). */
+static void
+put_entry (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  e->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
+/* Returns the cache entry for SECTOR, or a null pointer if
+   SECTOR is not cached.  The cache lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  key.sector = sector;
+  e = hash_find (&cache_table, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm, passing
+   over pinned entries.  If the chosen entry is clean, removes it
+   from the cache and returns it, marked invalid.  If it is
+   dirty, writes it back instead and returns a null pointer,
+   because the cache lock had to be released for the write.
+   Also returns a null pointer, after yielding the CPU, if every
+   entry is pinned.  The cache lock must be held. */
+static struct cache_entry *
+evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  /* Two sweeps clear every accessed bit on the way. */
+  for (i = 0; i < 2 * CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_CNT;
+
+      if (!e->valid)
+        return e;
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->accessed)
+        e->accessed = false;
+      else if (e->dirty)
+        {
+          /* E may point to sectors allocated since the free map
+             was last written, so write the free map first.  E
+             stays pinned meanwhile, so that it is not reused. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          free_map_flush ();
+          lock_acquire (&cache_lock);
+          e->pin_cnt--;
+          write_back (e);
+          return NULL;
+        }
+      else
+        {
+          if (e->read_ahead)
+            read_ahead_waste_cnt++;
+          hash_delete (&cache_table, &e->elem);
+          e->valid = false;
+          return e;
+        }
+    }
+
+  /* Every entry is in use.  Let their users finish. */
+  lock_release (&cache_lock);
+  thread_yield ();
+  lock_acquire (&cache_lock);
+  return NULL;
+}
+
+/* Writes valid entry E to the device if it is dirty, pinning it
+   and releasing the cache lock meanwhile.  The cache lock must
+   be held, and is held again on return. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (e->valid);
+
+  e->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+    }
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  e->pin_cnt--;
+}
+
+/* Flush thread.  Writes dirty sectors back periodically, to
+   limit how much is lost if the machine stops without shutting
+   down the file system. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Loads the sectors requested with
+   cache_read_ahead() that are not already cached. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_entry *e;
+      bool new;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_CNT;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      lock_acquire (&cache_lock);
+      if (lookup (sector) != NULL)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e = get_entry (sector, true, &new);
+      if (new)
+        block_read (fs_device, sector, e->data);
+      put_entry (e);
+    }
+}
+
+/* Returns a hash value for cache entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct cache_entry, elem)->sector);
+}
+
+/* Returns true if cache entry A's sector precedes B's. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, elem)->sector
+          < hash_entry (b, struct cache_entry, elem)->sector);
+}
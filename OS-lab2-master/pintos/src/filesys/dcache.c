@@ -0,0 +1,196 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a directory's inode sector and a name in that directory
+   to the inode sector the entry names, so that resolving a path
+   whose directories were resolved recently takes one hash table
+   probe per component, without searching any of the directories
+   along the way.  Callers probe it with the directory's lock
+   held, as dir_lookup() does, so that an entry is not used after
+   dir_remove() has removed it and its inode's sector has been
+   reused.
+
+   The cache holds up to DCACHE_CNT entries and evicts the least
+   recently used entry to make room for another.  Entries are
+   added by dir_lookup() and removed by dir_remove(), the only
+   way to change or remove a directory entry.  "." and ".." are
+   never cached: "." names the directory searched, which is open
+   already, and a directory's ".." would outlive the directory's
+   removal, when its sector may be reused. */
+
+/* Number of cached entries. */
+#define DCACHE_CNT 256
+
+/* A cached directory entry. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t parent;              /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within the directory. */
+    block_sector_t sector;              /* Inode sector named. */
+  };
+
+static struct dentry dentry_pool[DCACHE_CNT];
+static struct hash dentries;            /* Entries in use. */
+static struct list lru_list;            /* All entries, most recent first. */
+static struct lock dcache_lock;         /* Protects the cache. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups found in the cache. */
+static long long miss_cnt;              /* Lookups not found. */
+
+static struct dentry *find (block_sector_t parent, const char *name);
+static bool is_cacheable (const char *name);
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("directory entry cache creation failed");
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_CNT; i++)
+    list_push_back (&lru_list, &dentry_pool[i].lru_elem);
+  lock_init (&dcache_lock);
+  lock_profile (&dcache_lock, "dentry cache");
+}
+
+/* Looks up NAME in the directory whose inode is in sector
+   PARENT.  If it is cached, stores the sector of the inode it
+   names in *SECTORP and returns true.  Otherwise, returns false,
+   and the caller must search the directory itself. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      hit_cnt++;
+      *sectorp = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT names the inode in SECTOR. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (!is_cacheable (name))
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d == NULL)
+    {
+      /* Reuse the least recently used entry. */
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->name[0] != '\0')
+        hash_delete (&dentries, &d->hash_elem);
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets NAME in the directory whose inode is in sector PARENT,
+   if it is cached. */
+void
+dcache_remove (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      d->name[0] = '\0';
+      list_remove (&d->lru_elem);
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dentry cache: %lld hits, %lld misses\n", hit_cnt, miss_cnt);
+}
+
+/* Returns the cached entry for NAME in directory PARENT, or a
+   null pointer if there is none.  The cache lock must be held. */
+static struct dentry *
+find (block_sector_t parent, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  if (!is_cacheable (name))
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns true if entries named NAME may be cached. */
+static bool
+is_cacheable (const char *name)
+{
+  return (name[0] != '\0' && strlen (name) <= NAME_MAX
+          && strcmp (name, ".") && strcmp (name, ".."));
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -1,16 +1,21 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <bitmap.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    int ref_cnt;                        /* Number of references. */
   };
 
 /* A single directory entry. */
@@ -21,24 +26,99 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* In-memory index of a directory.
+
+   Finding an entry by name, or a free slot for a new entry,
+   would otherwise take a read of every entry in the directory.
+   Instead, the first time a directory is searched, all of its
+   entries are read and indexed in a hash table by name, and the
+   free slots are marked in a bitmap.  The index stays attached
+   to the directory's inode as long as the inode is open, and
+   dir_add() and dir_remove() keep it up to date.
+
+   The index is only a cache of the directory's contents.  If
+   memory for it runs out, it is dropped, and directories are
+   searched entry by entry until it can be rebuilt. */
+struct dir_index
+  {
+    struct hash names;                  /* Entries in use, by name. */
+    struct bitmap *free_slots;          /* Slots not in use. */
+    size_t slot_cnt;                    /* Slots in the directory. */
+  };
+
+/* An entry in use, in a directory index. */
+struct dir_name
+  {
+    struct hash_elem elem;              /* Element in names. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    size_t slot;                        /* Entry's slot in directory. */
+  };
+
+/* Number of entries read at once when building an index. */
+#define SCAN_CNT 16
+
+/* Locking.
+
+   Each directory is protected by its inode's operation lock.
+   dir_lookup() and dir_readdir() hold it shared, so lookups in a
+   directory run in parallel, and dir_add() and dir_remove() hold
+   it exclusively.  dir_remove() also holds the lock of a
+   directory that it removes, always taking the parent's lock
+   before the child's, so that no entry can be added to the
+   directory after it has been found empty.
+
+   A lookup may build the directory's index while it holds the
+   directory's lock only shared, so index_lock keeps two lookups
+   from building it at once. */
+static struct lock index_lock;
+
+static struct dir_index *get_index (const struct dir *);
+static struct dir_index *build_index (struct inode *);
+static void destroy_index (void *index);
+static void drop_index (struct inode *);
+static bool reserve_slots (struct dir_index *, size_t slot_cnt);
+static bool index_add (struct dir_index *, const char *name,
+                       block_sector_t inode_sector, size_t slot);
+static void index_remove (struct dir_index *, const char *name);
+static struct dir_name *index_find (struct dir_index *, const char *name);
+static hash_hash_func name_hash;
+static hash_less_func name_less;
+static hash_action_func name_destroy;
+static bool is_dot (const char *name);
+static bool is_empty (struct inode *);
+static bool read_entry (struct dir *, char name[NAME_MAX + 1]);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&index_lock);
+  lock_profile (&index_lock, "directory indexes");
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  The caller must then add its "." and ".."
+   entries.
+   Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), true);
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure, or if
+   INODE is not a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
   struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
+      dir->ref_cnt = 1;
       return dir;
     }
   else
@@ -65,11 +145,23 @@ dir_reopen (struct dir *dir)
   return dir_open (inode_reopen (dir->inode));
 }
 
-/* Destroys DIR and frees associated resources. */
+/* Returns another reference to DIR, which shares its position.
+   Returns a null pointer if DIR is null.  DIR is closed once
+   every reference has been passed to dir_close(). */
+struct dir *
+dir_dup (struct dir *dir)
+{
+  if (dir != NULL)
+    dir->ref_cnt++;
+  return dir;
+}
+
+/* Drops a reference to DIR, and destroys DIR and frees associated
+   resources if it was the last one. */
 void
 dir_close (struct dir *dir) 
 {
-  if (dir != NULL)
+  if (dir != NULL && --dir->ref_cnt == 0)
     {
       inode_close (dir->inode);
       free (dir);
@@ -92,12 +184,31 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct dir_name *n = index_find (index, name);
+      if (n == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = n->inode_sector;
+          strlcpy (ep->name, n->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = n->slot * sizeof e;
+      return true;
+    }
+
+  /* No index, so search entry by entry. */
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -114,20 +225,33 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Fails if DIR has been removed, since the directories its ".."
+   entry leads to may have been removed as well. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  inode_lock_shared (dir->inode);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (inode_is_removed (dir->inode))
+    *inode = NULL;
+  else if (dcache_lookup (dir_sector, name, &sector))
+    *inode = inode_open (sector);
+  else if (lookup (dir, name, &e, NULL))
+    {
+      dcache_insert (dir_sector, name, e.inode_sector);
+      *inode = inode_open (e.inode_sector);
+    }
   else
     *inode = NULL;
+  inode_unlock_shared (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,11 +260,12 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,6 +277,11 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* Check that DIR is still there to add to. */
+  inode_lock_exclusive (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
@@ -163,10 +293,19 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      size_t slot = bitmap_scan (index->free_slots, 0, 1, true);
+      if (slot == BITMAP_ERROR)
+        slot = index->slot_cnt;
+      ofs = slot * sizeof e;
+    }
+  else
+    for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+      if (!e.in_use)
+        break;
 
   /* Write slot. */
   e.in_use = true;
@@ -174,18 +313,26 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Index the new entry. */
+  if (success && index != NULL
+      && !index_add (index, name, inode_sector, ofs / sizeof e))
+    drop_index (dir->inode);
+
  done:
+  inode_unlock_exclusive (dir->inode);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs
+   only if there is no file with the given NAME, if NAME is "."
+   or "..", or if NAME is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
   off_t ofs;
 
@@ -193,7 +340,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock_exclusive (dir->inode);
+  if (is_dot (name) || !lookup (dir, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,32 +349,62 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove empty directories, and keep entries from being
+     added to one until it is marked removed. */
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      inode_lock_exclusive (inode);
+      if (!is_empty (inode))
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (inode_get_aux (dir->inode) != NULL)
+    index_remove (inode_get_aux (dir->inode), name);
+  dcache_remove (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock_exclusive (inode);
+  inode_unlock_exclusive (dir->inode);
   inode_close (inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Reads the next directory entry in DIR, other than "." and
+   "..", and stores the name in NAME.  Returns true if
+   successful, false if the directory contains no more
+   entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool success;
+
+  inode_lock_shared (dir->inode);
+  success = read_entry (dir, name);
+  inode_unlock_shared (dir->inode);
+  return success;
+}
+
+/* Reads the next directory entry in DIR, like dir_readdir(), but
+   with DIR's lock already held. */
+static bool
+read_entry (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && !is_dot (e.name))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +412,227 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Returns DIR's index, building it first if DIR does not have
+   one yet.  Returns a null pointer if memory for the index is
+   not available. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_aux (dir->inode);
+
+  if (index == NULL)
+    {
+      lock_acquire (&index_lock);
+      index = inode_get_aux (dir->inode);
+      if (index == NULL)
+        {
+          index = build_index (dir->inode);
+          if (index != NULL)
+            inode_set_aux (dir->inode, index, destroy_index);
+        }
+      lock_release (&index_lock);
+    }
+  return index;
+}
+
+/* Reads all the entries of the directory in INODE and returns an
+   index of them, or a null pointer if memory runs out. */
+static struct dir_index *
+build_index (struct inode *inode)
+{
+  struct dir_entry entries[SCAN_CNT];
+  struct dir_index *index;
+  off_t ofs;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  index->free_slots = NULL;
+  index->slot_cnt = 0;
+  if (!hash_init (&index->names, name_hash, name_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+
+  for (ofs = 0; ; ofs += sizeof entries)
+    {
+      off_t size = inode_read_at (inode, entries, sizeof entries, ofs);
+      size_t cnt = size / sizeof *entries;
+      size_t i;
+
+      if (!reserve_slots (index, index->slot_cnt + cnt))
+        goto error;
+      for (i = 0; i < cnt; i++)
+        if (entries[i].in_use)
+          {
+            if (!index_add (index, entries[i].name, entries[i].inode_sector,
+                            index->slot_cnt))
+              goto error;
+          }
+        else
+          bitmap_mark (index->free_slots, index->slot_cnt++);
+      if (cnt < SCAN_CNT)
+        break;
+    }
+  return index;
+
+ error:
+  destroy_index (index);
+  return NULL;
+}
+
+/* Frees INDEX, a struct dir_index. */
+static void
+destroy_index (void *index_)
+{
+  struct dir_index *index = index_;
+
+  hash_destroy (&index->names, name_destroy);
+  bitmap_destroy (index->free_slots);
+  free (index);
+}
+
+/* Destroys the index of the directory in INODE, if it has one. */
+static void
+drop_index (struct inode *inode)
+{
+  struct dir_index *index = inode_get_aux (inode);
+
+  if (index != NULL)
+    {
+      inode_set_aux (inode, NULL, NULL);
+      destroy_index (index);
+    }
+}
+
+/* Makes room in INDEX's free slot bitmap for SLOT_CNT slots.
+   Returns true if successful, false if memory runs out. */
+static bool
+reserve_slots (struct dir_index *index, size_t slot_cnt)
+{
+  struct bitmap *free_slots;
+  size_t size, i;
+
+  if (index->free_slots != NULL
+      && bitmap_size (index->free_slots) >= slot_cnt)
+    return true;
+
+  /* Double the size, so that a directory growing entry by entry
+     copies its bitmap only a logarithmic number of times. */
+  size = index->free_slots != NULL ? bitmap_size (index->free_slots) * 2 : 0;
+  if (size < slot_cnt)
+    size = slot_cnt;
+  if (size < SCAN_CNT)
+    size = SCAN_CNT;
+  free_slots = bitmap_create (size);
+  if (free_slots == NULL)
+    return false;
+  for (i = 0; i < index->slot_cnt; i++)
+    if (bitmap_test (index->free_slots, i))
+      bitmap_mark (free_slots, i);
+
+  bitmap_destroy (index->free_slots);
+  index->free_slots = free_slots;
+  return true;
+}
+
+/* Adds an entry named NAME for the inode in INODE_SECTOR in slot
+   SLOT, which must be free or just past the end of the directory,
+   to INDEX.  Returns true if successful, false if memory runs
+   out. */
+static bool
+index_add (struct dir_index *index, const char *name,
+           block_sector_t inode_sector, size_t slot)
+{
+  struct dir_name *n;
+
+  ASSERT (slot <= index->slot_cnt);
+
+  if (!reserve_slots (index, slot + 1))
+    return false;
+  n = malloc (sizeof *n);
+  if (n == NULL)
+    return false;
+  strlcpy (n->name, name, sizeof n->name);
+  n->inode_sector = inode_sector;
+  n->slot = slot;
+  hash_insert (&index->names, &n->elem);
+
+  if (slot == index->slot_cnt)
+    index->slot_cnt++;
+  else
+    bitmap_reset (index->free_slots, slot);
+  return true;
+}
+
+/* Removes the entry named NAME, which must exist, from INDEX. */
+static void
+index_remove (struct dir_index *index, const char *name)
+{
+  struct dir_name *n = index_find (index, name);
+
+  ASSERT (n != NULL);
+  hash_delete (&index->names, &n->elem);
+  bitmap_mark (index->free_slots, n->slot);
+  free (n);
+}
+
+/* Returns the entry named NAME in INDEX, or a null pointer if
+   there is none. */
+static struct dir_name *
+index_find (struct dir_index *index, const char *name)
+{
+  struct dir_name key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->names, &key.elem);
+  return e != NULL ? hash_entry (e, struct dir_name, elem) : NULL;
+}
+
+/* Returns a hash value for dir_name E. */
+static unsigned
+name_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct dir_name, elem)->name);
+}
+
+/* Returns true if dir_name A's name precedes dir_name B's. */
+static bool
+name_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct dir_name, elem)->name,
+                 hash_entry (b, struct dir_name, elem)->name) < 0;
+}
+
+/* Frees dir_name E. */
+static void
+name_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct dir_name, elem));
+}
+
+/* Returns true if NAME is "." or "..". */
+static bool
+is_dot (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
+/* Returns true if the directory in INODE has no entries other
+   than "." and "..". */
+static bool
+is_empty (struct inode *inode)
+{
+  struct dir *dir = dir_open (inode_reopen (inode));
+  char name[NAME_MAX + 1];
+  bool empty = dir != NULL && !read_entry (dir, name);
+
+  dir_close (dir);
+  return empty;
+}
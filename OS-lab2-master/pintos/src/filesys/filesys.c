@@ -2,15 +2,22 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool create (const char *path, off_t initial_size, bool is_dir);
+static bool add_dots (struct inode *, block_sector_t parent);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static int next_part (char part[NAME_MAX + 1], const char **srcp);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +28,10 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
+  dir_init ();
   free_map_init ();
 
   if (format) 
@@ -36,6 +46,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -45,20 +56,21 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  return create (name, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME, which may also be a
+   directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,38 +78,218 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, part, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file named NAME, which may also be an empty
+   directory.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  bool success = dir != NULL && dir_remove (dir, part);
   dir_close (dir); 
 
   return success;
 }
+
+/* Changes the running process's working directory to the
+   directory named NAME.
+   Returns true if successful, false on failure.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *cur = thread_current ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (cur->cwd);
+  cur->cwd = dir;
+  return true;
+}
 
 /* Formats the file system. */
 static void
 do_format (void)
 {
+  struct inode *root;
+
   printf ("Formatting file system...");
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  root = inode_open (ROOT_DIR_SECTOR);
+  if (root == NULL || !add_dots (root, ROOT_DIR_SECTOR))
+    PANIC ("root directory creation failed");
+  inode_close (root);
   free_map_close ();
   printf ("done.\n");
 }
+
+/* Creates a file named PATH, a directory if IS_DIR is true or
+   an ordinary file with the given INITIAL_SIZE otherwise.
+   Returns true if successful, false otherwise.
+
+   Once the new inode has been written, a failure removes it
+   with inode_remove(), which releases every sector it owns and
+   drops it from the inode table.  Only if memory runs out before
+   it can even be opened are its sectors left allocated. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t inode_sector;
+  struct dir *dir = resolve (path, name);
+  struct inode *inode = NULL;
+  bool success = false;
+
+  /* Fail before allocating anything if NAME is in use.  dir_add()
+     checks again, in case it is added meanwhile. */
+  if (dir == NULL || dir_lookup (dir, name, &inode)
+      || !free_map_allocate (1, &inode_sector))
+    goto done;
+  if (!(is_dir
+        ? dir_create (inode_sector, 16)
+        : inode_create (inode_sector, initial_size, false)))
+    {
+      free_map_release (inode_sector, 1);
+      goto done;
+    }
+
+  inode = inode_open (inode_sector);
+  if (inode == NULL)
+    goto done;
+  success = ((!is_dir
+              || add_dots (inode, inode_get_inumber (dir_get_inode (dir))))
+             && dir_add (dir, name, inode_sector));
+  if (!success)
+    inode_remove (inode);
+
+ done:
+  inode_close (inode);
+  dir_close (dir);
+  return success;
+}
+
+/* Adds the "." and ".." entries to new directory INODE, with ".."
+   naming the directory whose inode is in sector PARENT.
+   Returns true if successful, false on failure. */
+static bool
+add_dots (struct inode *inode, block_sector_t parent)
+{
+  struct dir *dir = dir_open (inode_reopen (inode));
+  bool success = (dir != NULL
+                  && dir_add (dir, ".", inode_get_inumber (inode))
+                  && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
+}
+
+/* Resolves PATH, which is relative to the running process's
+   working directory unless it starts with "/", up to its last
+   component.  Stores the last component into NAME and returns
+   the directory that should contain it, which the caller must
+   close.  A path with no components, such as "/", names the
+   directory it starts from, so NAME is then ".".
+   Returns a null pointer if PATH is empty, if one of its
+   components is longer than NAME_MAX, or if one of the
+   directories along the way does not exist or has been removed.
+
+   Each directory along the way is opened by dir_lookup() in its
+   parent while the parent's lock is held, so that it cannot be
+   removed and its sector reused between being found and being
+   opened.  The lookups themselves mostly hit the directory
+   entry cache. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+
+  if (*path == '/' || cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (cwd);
+
+  result = next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (result > 0 && dir != NULL)
+    {
+      result = next_part (next, &path);
+      if (result > 0)
+        {
+          struct inode *inode;
+
+          dir_lookup (dir, name, &inode);
+          dir_close (dir);
+          dir = dir_open (inode);
+          strlcpy (name, next, NAME_MAX + 1);
+        }
+    }
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+
+  if (dir != NULL && inode_is_removed (dir_get_inode (dir)))
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Extracts the next component of the path at *SRCP into PART
+   and advances *SRCP past it.  Returns 1 if successful, 0 if
+   there are no more components, or -1 if the next component is
+   longer than NAME_MAX characters. */
+static int
+next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  size_t len;
+
+  /* Skip leading slashes. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy the component. */
+  for (len = 0; src[len] != '/' && src[len] != '\0'; len++)
+    if (len >= NAME_MAX)
+      return -1;
+  memcpy (part, src, len);
+  part[len] = '\0';
+  *srcp = src + len;
+  return 1;
+}
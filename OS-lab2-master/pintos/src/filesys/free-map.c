@@ -1,42 +1,186 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects the free map. */
+
+/* Changes to the free map are not written to the free map file
+   right away.  Instead, the sectors of the file that hold changed
+   bits are marked in DIRTY_SECTORS, and only those are written,
+   by free_map_flush().  The buffer cache calls it before it
+   writes back any dirty sector, so that sectors allocated to a
+   file are recorded on disk no later than the inode or index
+   block that points to them.
+
+   free_map_flush() writes straight to the sectors of the free map
+   file, recorded in FILE_SECTORS, with cache_write_through().
+   Writing through the file would put the changes in the cache,
+   where they could reach the disk after the sectors that depend
+   on them, and could make the cache evict another sector, and so
+   call free_map_flush() again, in the middle of the flush. */
+static struct bitmap *dirty_sectors; /* One bit per free map file sector. */
+static block_sector_t *file_sectors; /* Free map file's data sectors. */
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Free extents.
+
+   The free map bitmap is what is stored on disk, but searching
+   it for free sectors takes time proportional to the size of the
+   disk.  So the free space is also indexed in memory as a set of
+   maximal runs of free sectors, called extents.
+
+   Two hash tables find an extent by its first sector and by the
+   sector just past its end.  Freed sectors are merged with the
+   extents on either side through them, and a file that grows is
+   given the extent that starts just past its last allocation.
+
+   For other allocations, extents are also kept in size classes,
+   one list per power of 2, and SIZE_CLASSES has a bit set for
+   each list that is not empty.  An allocation takes the first
+   extent of the smallest class whose extents are all large
+   enough.  Only if no such class has an extent is the class that
+   may hold large enough extents searched.  So neither allocating
+   nor freeing looks at more than a few extents, except on a disk
+   too fragmented to satisfy the request otherwise.
+
+   The index needs memory for each extent.  If an allocation
+   fails, the index is dropped and the bitmap is searched instead
+   until the index can be rebuilt. */
+struct extent
+  {
+    struct hash_elem start_elem;     /* Element in extents_by_start. */
+    struct hash_elem end_elem;       /* Element in extents_by_end. */
+    struct list_elem class_elem;     /* Element in its size class. */
+    block_sector_t start;            /* First free sector. */
+    size_t cnt;                      /* Number of free sectors. */
+  };
+
+/* Number of size classes.  Class K holds the extents of 2**K to
+   2**(K + 1) - 1 sectors. */
+#define CLASS_CNT 32
+
+static struct hash extents_by_start; /* Extents by first sector. */
+static struct hash extents_by_end;   /* Extents by sector past end. */
+static struct list classes[CLASS_CNT]; /* Extents by size class. */
+static uint32_t size_classes;        /* Bit K set if classes[K] is used. */
+static bool index_valid;             /* False if the index was dropped. */
+
+static void mark_dirty (block_sector_t, size_t cnt);
+static void map_file_sectors (void);
+static bool build_index (void);
+static void clear_index (void);
+static struct extent *find_best_fit (size_t cnt);
+static struct extent *find_by_start (block_sector_t);
+static struct extent *find_by_end (block_sector_t);
+static void take_from_extent (struct extent *, size_t cnt);
+static bool return_to_index (block_sector_t, size_t cnt);
+static void insert_extent (struct extent *);
+static void remove_extent (struct extent *);
+static int size_class (size_t cnt);
+static hash_hash_func start_hash;
+static hash_less_func start_less;
+static hash_hash_func end_hash;
+static hash_less_func end_less;
+static hash_action_func free_extent;
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t i;
+
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  lock_init (&free_map_lock);
+  lock_profile (&free_map_lock, "free map");
+
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  file_sectors = malloc (bitmap_size (dirty_sectors) * sizeof *file_sectors);
+  if (file_sectors == NULL)
+    PANIC ("free map file sector table creation failed");
+
+  if (!hash_init (&extents_by_start, start_hash, start_less, NULL)
+      || !hash_init (&extents_by_end, end_hash, end_less, NULL))
+    PANIC ("free extent index creation failed");
+  for (i = 0; i < CLASS_CNT; i++)
+    list_init (&classes[i]);
+  index_valid = build_index ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Takes them from a free extent of the
+   smallest size class that fits, to keep large extents whole.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, BITMAP_ERROR, sectorp);
+}
+
+/* Like free_map_allocate(), but if HINT is not BITMAP_ERROR,
+   prefers CNT sectors starting at HINT, if they begin a free
+   extent.  Allocating a growing file's sectors with a hint just
+   past its last allocation keeps the file contiguous, because
+   what is left of an extent after an allocation starts there. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t hint,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  if (!index_valid)
+    index_valid = build_index ();
+
+  if (index_valid)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      struct extent *e = NULL;
+
+      if (hint != BITMAP_ERROR)
+        {
+          e = find_by_start (hint);
+          if (e != NULL && e->cnt < cnt)
+            e = NULL;
+        }
+      if (e == NULL)
+        e = find_best_fit (cnt);
+      if (e != NULL)
+        {
+          sector = e->start;
+          take_from_extent (e, cnt);
+          bitmap_set_multiple (free_map, sector, cnt, true);
+        }
     }
+  else
+    sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
@@ -44,9 +188,36 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (index_valid && !return_to_index (sector, cnt))
+    clear_index ();
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that hold changes made
+   since they were last written. */
+void
+free_map_flush (void)
+{
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];   /* Protected by the lock. */
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    for (i = bitmap_scan (dirty_sectors, 0, 1, true); i != BITMAP_ERROR;
+         i = bitmap_scan (dirty_sectors, i + 1, 1, true))
+      {
+        size_t size = bitmap_get_bytes (free_map, buffer,
+                                        i * BLOCK_SECTOR_SIZE,
+                                        BLOCK_SECTOR_SIZE);
+        memset (buffer + size, 0, BLOCK_SECTOR_SIZE - size);
+        cache_write_through (file_sectors[i], buffer);
+        bitmap_reset (dirty_sectors, i);
+      }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +229,19 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  map_file_sectors ();
+  bitmap_set_all (dirty_sectors, false);
+  clear_index ();
+  index_valid = build_index ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -73,7 +250,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -82,4 +259,280 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  map_file_sectors ();
+  bitmap_set_all (dirty_sectors, false);
+}
+
+/* Marks the free map file sectors that hold the bits for the CNT
+   sectors starting at SECTOR as needing to be written. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
+}
+
+/* Records the sectors of the free map file in FILE_SECTORS.  The
+   free map file is created at its full size, so none of them can
+   be missing. */
+static void
+map_file_sectors (void)
+{
+  struct inode *inode = file_get_inode (free_map_file);
+  size_t i;
+
+  for (i = 0; i < bitmap_size (dirty_sectors); i++)
+    {
+      file_sectors[i] = inode_byte_to_sector (inode, i * BLOCK_SECTOR_SIZE);
+      if (file_sectors[i] == 0)
+        PANIC ("free map file is missing sector %zu", i);
+    }
+}
+
+/* Builds the extent index from the free map bitmap.  Returns
+   true if successful, false if memory ran out, in which case the
+   index is left empty. */
+static bool
+build_index (void)
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t start = 0;
+
+  ASSERT (hash_empty (&extents_by_start));
+
+  for (;;)
+    {
+      struct extent *e;
+      size_t end;
+
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR)
+        return true;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = sector_cnt;
+
+      e = malloc (sizeof *e);
+      if (e == NULL)
+        {
+          clear_index ();
+          return false;
+        }
+      e->start = start;
+      e->cnt = end - start;
+      insert_extent (e);
+      start = end;
+    }
+}
+
+/* Frees all the extents in the index and marks it invalid. */
+static void
+clear_index (void)
+{
+  size_t i;
+
+  hash_clear (&extents_by_end, NULL);
+  hash_clear (&extents_by_start, free_extent);
+  for (i = 0; i < CLASS_CNT; i++)
+    list_init (&classes[i]);
+  size_classes = 0;
+  index_valid = false;
+}
+
+/* Returns an extent of at least CNT sectors, or a null pointer
+   if there is none.  Prefers an extent from the smallest size
+   class all of whose extents are large enough, to keep larger
+   extents whole. */
+static struct extent *
+find_best_fit (size_t cnt)
+{
+  int class = size_class (cnt);
+  int fit_class = (cnt & (cnt - 1)) == 0 ? class : class + 1;
+  uint32_t fits = fit_class < CLASS_CNT ? size_classes >> fit_class : 0;
+  struct list_elem *elem;
+
+  /* Any extent of FIT_CLASS or above is large enough. */
+  if (fits != 0)
+    {
+      struct list *list = &classes[fit_class + __builtin_ctz (fits)];
+      return list_entry (list_front (list), struct extent, class_elem);
+    }
+
+  /* Only some extents of CLASS may be. */
+  if (fit_class != class)
+    for (elem = list_begin (&classes[class]);
+         elem != list_end (&classes[class]); elem = list_next (elem))
+      {
+        struct extent *e = list_entry (elem, struct extent, class_elem);
+        if (e->cnt >= cnt)
+          return e;
+      }
+  return NULL;
+}
+
+/* Returns the extent that starts at SECTOR, or a null pointer if
+   there is none. */
+static struct extent *
+find_by_start (block_sector_t sector)
+{
+  struct extent key;
+  struct hash_elem *e;
+
+  key.start = sector;
+  e = hash_find (&extents_by_start, &key.start_elem);
+  return e != NULL ? hash_entry (e, struct extent, start_elem) : NULL;
+}
+
+/* Returns the extent that ends just before SECTOR, or a null
+   pointer if there is none. */
+static struct extent *
+find_by_end (block_sector_t sector)
+{
+  struct extent key;
+  struct hash_elem *e;
+
+  key.start = sector;
+  key.cnt = 0;
+  e = hash_find (&extents_by_end, &key.end_elem);
+  return e != NULL ? hash_entry (e, struct extent, end_elem) : NULL;
+}
+
+/* Takes the first CNT sectors out of extent E, which must have
+   at least that many.  Whatever is left of E stays in the
+   index. */
+static void
+take_from_extent (struct extent *e, size_t cnt)
+{
+  ASSERT (e->cnt >= cnt);
+
+  remove_extent (e);
+  if (e->cnt > cnt)
+    {
+      e->start += cnt;
+      e->cnt -= cnt;
+      insert_extent (e);
+    }
+  else
+    free (e);
+}
+
+/* Adds the CNT free sectors starting at SECTOR to the index,
+   merging them with adjacent extents.  Returns true if
+   successful, false if memory ran out. */
+static bool
+return_to_index (block_sector_t sector, size_t cnt)
+{
+  struct extent *prev = find_by_end (sector);
+  struct extent *next = find_by_start (sector + cnt);
+
+  if (prev != NULL)
+    {
+      remove_extent (prev);
+      prev->cnt += cnt;
+      if (next != NULL)
+        {
+          remove_extent (next);
+          prev->cnt += next->cnt;
+          free (next);
+        }
+      insert_extent (prev);
+    }
+  else if (next != NULL)
+    {
+      remove_extent (next);
+      next->start = sector;
+      next->cnt += cnt;
+      insert_extent (next);
+    }
+  else
+    {
+      struct extent *e = malloc (sizeof *e);
+      if (e == NULL)
+        return false;
+      e->start = sector;
+      e->cnt = cnt;
+      insert_extent (e);
+    }
+  return true;
+}
+
+/* Adds E to the index. */
+static void
+insert_extent (struct extent *e)
+{
+  int class = size_class (e->cnt);
+
+  hash_insert (&extents_by_start, &e->start_elem);
+  hash_insert (&extents_by_end, &e->end_elem);
+  list_push_front (&classes[class], &e->class_elem);
+  size_classes |= 1u << class;
+}
+
+/* Removes E from the index. */
+static void
+remove_extent (struct extent *e)
+{
+  int class = size_class (e->cnt);
+
+  hash_delete (&extents_by_start, &e->start_elem);
+  hash_delete (&extents_by_end, &e->end_elem);
+  list_remove (&e->class_elem);
+  if (list_empty (&classes[class]))
+    size_classes &= ~(1u << class);
+}
+
+/* Returns the size class of an extent of CNT sectors, which must
+   be positive: the number of the highest bit set in CNT. */
+static int
+size_class (size_t cnt)
+{
+  ASSERT (cnt > 0);
+  return 31 - __builtin_clz (cnt);
+}
+
+/* Returns a hash of extent E_'s first sector. */
+static unsigned
+start_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct extent *e = hash_entry (e_, struct extent, start_elem);
+  return hash_int (e->start);
+}
+
+/* Returns true if extent A_ starts before extent B_. */
+static bool
+start_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct extent *a = hash_entry (a_, struct extent, start_elem);
+  const struct extent *b = hash_entry (b_, struct extent, start_elem);
+
+  return a->start < b->start;
+}
+
+/* Returns a hash of the sector just past extent E_. */
+static unsigned
+end_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct extent *e = hash_entry (e_, struct extent, end_elem);
+  return hash_int (e->start + e->cnt);
+}
+
+/* Returns true if extent A_ ends before extent B_. */
+static bool
+end_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct extent *a = hash_entry (a_, struct extent, end_elem);
+  const struct extent *b = hash_entry (b_, struct extent, end_elem);
+
+  return a->start + a->cnt < b->start + b->cnt;
+}
+
+/* Frees extent E_, for hash_clear(). */
+static void
+free_extent (struct hash_elem *e_, void *aux UNUSED)
+{
+  free (hash_entry (e_, struct extent, start_elem));
 }
@@ -9,6 +9,7 @@
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -221,3 +222,52 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Measures the cost of byte-granular file access: writes ARGV[1]
+   bytes to a scratch file one byte at a time, reads them back
+   one byte at a time, and prints the CPU cycles per byte that
+   each pass took.  Deletes the scratch file afterward. */
+void
+fsutil_bench (char **argv)
+{
+  static const char file_name[] = "bench-io.tmp";
+  int size = atoi (argv[1]);
+  uint64_t start, write_cycles, read_cycles;
+  struct file *file;
+  int i;
+
+  if (size <= 0)
+    PANIC ("bench-io: bad size '%s'", argv[1]);
+
+  printf ("Timing %d one-byte writes and reads of '%s'...\n",
+          size, file_name);
+  if (!filesys_create (file_name, 0))
+    PANIC ("%s: create failed", file_name);
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+
+  start = read_tsc ();
+  for (i = 0; i < size; i++)
+    {
+      uint8_t byte = i;
+      if (file_write (file, &byte, 1) != 1)
+        PANIC ("%s: write failed at byte %d", file_name, i);
+    }
+  write_cycles = read_tsc () - start;
+
+  file_seek (file, 0);
+  start = read_tsc ();
+  for (i = 0; i < size; i++)
+    {
+      uint8_t byte;
+      if (file_read (file, &byte, 1) != 1 || byte != (uint8_t) i)
+        PANIC ("%s: read failed at byte %d", file_name, i);
+    }
+  read_cycles = read_tsc () - start;
+
+  file_close (file);
+  filesys_remove (file_name);
+  printf ("bench-io: write %llu cycles/byte, read %llu cycles/byte\n",
+          write_cycles / size, read_cycles / size);
+}
@@ -1,78 +1,302 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Read-ahead window, in sectors, when sequential reading is
+   first detected, and the most it grows to. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 16
+
+/* Number of closed inodes kept in memory. */
+#define CLOSED_CNT 32
+
+/* Number of sectors reserved at a time for a file's data and
+   index blocks. */
+#define PREALLOC_CNT 8
+
+/* Number of direct sector pointers in an on-disk inode. */
+#define DIRECT_CNT 123
+
+/* Number of sector pointers in an indirect block. */
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The file's data sectors are found through DIRECT_CNT direct
+   pointers, then one indirect block of INDIRECT_CNT pointers,
+   then one doubly indirect block of pointers to indirect blocks.
+   A pointer of 0 means that no sector has been allocated, either
+   for data or for an index block, and that the data there reads
+   as zeros.  (Sector 0 holds the free map inode, so it is never
+   a data or index block.) */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
+    uint32_t is_dir;                    /* 1 for a directory, else 0. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* Sectors reserved for a file but not yet used.
+
+   A file allocates its sectors one at a time as it grows, so
+   files growing side by side would end up interleaved on disk.
+   Instead, each file reserves a run of PREALLOC_CNT sectors at a
+   time and hands them out in order, asking for each new run to
+   start just past the previous one.  Reserved sectors that are
+   still unused when the file is closed are released. */
+struct prealloc
+  {
+    block_sector_t next;                /* Next reserved sector. */
+    size_t cnt;                         /* Number of reserved sectors. */
+  };
 
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    /* Protected by inode_table_lock. */
+    struct hash_elem elem;              /* Element in inode table. */
+    struct list_elem closed_elem;       /* Element in closed inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loaded;                        /* True once DATA has been read. */
+    struct condition loaded_cond;       /* Signaled when LOADED is set. */
+
+    /* Protected by RW: held for reading to read the file, and for
+       writing to write it or change the members below. */
+    struct rwlock rw;                   /* Readers-writer lock. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct prealloc prealloc;           /* Reserved sectors. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Held by other modules across operations that take several
+       reads and writes, through inode_lock_shared() and
+       inode_lock_exclusive().  Unlike RW, it is never taken by
+       this module. */
+    struct rwlock op_rw;                /* Lock for operations. */
+
+    /* Protected by the module that attached the data. */
+    void *aux;                          /* Data attached by other modules. */
+    inode_aux_destroy_func *aux_destroy; /* Destroys AUX. */
   };
 
+static block_sector_t map_pointer (struct inode_disk *, block_sector_t,
+                                   block_sector_t *, struct prealloc *);
+static block_sector_t map_index (block_sector_t, size_t idx,
+                                 struct prealloc *);
+static bool allocate_zeroed (block_sector_t *, struct prealloc *);
+static void prealloc_init (struct prealloc *, block_sector_t inode_sector);
+static void prealloc_release (struct prealloc *);
+static void free_inode (struct inode *);
+static void forget_inode (block_sector_t);
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static void release_sectors (const struct inode_disk *);
+static void release_index (block_sector_t, int level);
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within the file whose on-disk inode DISK is stored in
+   INODE_SECTOR.
+   If no sector has been allocated there yet and PA is nonnull,
+   allocates one, zeroed, from PA, along with any index blocks
+   needed to reach it, updating the inode on disk.  Otherwise, and
+   if allocation fails or POS is beyond the largest possible file,
+   returns 0. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode_disk *disk, block_sector_t inode_sector,
+                off_t pos, struct prealloc *pa)
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t index;
+
+  ASSERT (disk != NULL);
+  ASSERT (pos >= 0);
+
+  if (idx < DIRECT_CNT)
+    return map_pointer (disk, inode_sector, &disk->direct[idx], pa);
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    {
+      index = map_pointer (disk, inode_sector, &disk->indirect, pa);
+      return index != 0 ? map_index (index, idx, pa) : 0;
+    }
+  idx -= INDIRECT_CNT;
+
+  if (idx < INDIRECT_CNT * INDIRECT_CNT)
+    {
+      index = map_pointer (disk, inode_sector, &disk->doubly_indirect, pa);
+      if (index != 0)
+        index = map_index (index, idx / INDIRECT_CNT, pa);
+      return index != 0 ? map_index (index, idx % INDIRECT_CNT, pa) : 0;
+    }
+  return 0;
+}
+
+/* Returns the sector that *POINTER, a pointer in on-disk inode
+   DISK stored in INODE_SECTOR, points to.  If it is 0 and PA is
+   nonnull, first allocates a zeroed sector for it from PA and
+   writes the pointer back to DISK's sector. */
+static block_sector_t
+map_pointer (struct inode_disk *disk, block_sector_t inode_sector,
+             block_sector_t *pointer, struct prealloc *pa)
+{
+  if (*pointer == 0 && pa != NULL && allocate_zeroed (pointer, pa))
+    cache_write (inode_sector, pointer,
+                 (uint8_t *) pointer - (uint8_t *) disk, sizeof *pointer);
+  return *pointer;
+}
+
+/* Returns pointer IDX in index block INDEX.  If it is 0 and PA
+   is nonnull, first allocates a zeroed sector for it from PA. */
+static block_sector_t
+map_index (block_sector_t index, size_t idx, struct prealloc *pa)
+{
+  block_sector_t sector;
+
+  ASSERT (idx < INDIRECT_CNT);
+
+  cache_read (index, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && pa != NULL && allocate_zeroed (&sector, pa))
+    cache_write (index, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Takes the next sector reserved in PA, reserving more first if
+   none is left, fills it with zeros, and stores it into *SECTORP.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp, struct prealloc *pa)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (pa->cnt == 0)
+    {
+      /* Reserve a run just past the previous one, or a single
+         sector if no run that long is free. */
+      if (free_map_allocate_near (PREALLOC_CNT, pa->next, &pa->next))
+        pa->cnt = PREALLOC_CNT;
+      else if (free_map_allocate_near (1, pa->next, &pa->next))
+        pa->cnt = 1;
+      else
+        return false;
+    }
+  *sectorp = pa->next++;
+  pa->cnt--;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Initializes PA with no sectors reserved, so that the first
+   reservation for the file whose inode is in INODE_SECTOR starts
+   right after it. */
+static void
+prealloc_init (struct prealloc *pa, block_sector_t inode_sector)
+{
+  pa->next = inode_sector + 1;
+  pa->cnt = 0;
+}
+
+/* Releases the sectors reserved in PA but not used. */
+static void
+prealloc_release (struct prealloc *pa)
+{
+  if (pa->cnt > 0)
+    free_map_release (pa->next, pa->cnt);
+  pa->cnt = 0;
+}
+
+/* Releases all of the data and index sectors of the file whose
+   on-disk inode is DISK, but not the inode's own sector. */
+static void
+release_sectors (const struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  if (disk->indirect != 0)
+    release_index (disk->indirect, 1);
+  if (disk->doubly_indirect != 0)
+    release_index (disk->doubly_indirect, 2);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Releases index block INDEX and the sectors it points to.  If
+   LEVEL is greater than 1, those are themselves index blocks, to
+   be released at LEVEL - 1. */
+static void
+release_index (block_sector_t index, int level)
+{
+  size_t i;
+
+  for (i = 0; i < INDIRECT_CNT; i++)
+    {
+      block_sector_t sector;
+
+      cache_read (index, &sector, i * sizeof sector, sizeof sector);
+      if (sector == 0)
+        continue;
+      if (level > 1)
+        release_index (sector, level - 1);
+      else
+        free_map_release (sector, 1);
+    }
+  free_map_release (index, 1);
+}
+
+/* Table of open inodes, by sector, so that opening a single
+   inode twice returns the same `struct inode'.
+
+   An inode stays in the table after its last opener closes it,
+   on the list of closed inodes, until CLOSED_CNT inodes closed
+   more recently push it out.  Reopening it until then needs no
+   disk access, and keeps the data attached with
+   inode_set_aux().  If its sector is freed and reused for a new
+   inode first, inode_create() drops it. */
+static struct hash open_inodes;
+static struct list closed_inodes;       /* Most recently closed first. */
+static size_t closed_cnt;               /* Number of closed inodes. */
+static struct lock inode_table_lock;    /* Protects the above. */
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("inode table creation failed");
+  list_init (&closed_inodes);
+  lock_init (&inode_table_lock);
+  lock_profile (&inode_table_lock, "inode table");
 }
 
-/* Initializes an inode with LENGTH bytes of data and
+/* Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR is true or an ordinary file otherwise, and
    writes the new inode to sector SECTOR on the file system
    device.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
+  struct prealloc pa;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -81,25 +305,35 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  /* The inode table may still hold an inode that used to be in
+     SECTOR. */
+  forget_inode (sector);
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      off_t pos;
+
       disk_inode->length = length;
+      disk_inode->is_dir = is_dir;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+
+      /* Write the inode first, so that allocation below only
+         has to update its pointers in the cache. */
+      cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+
+      /* Allocate the initial LENGTH bytes now, so that writes
+         within them cannot fail for lack of space. */
+      prealloc_init (&pa, sector);
+      success = true;
+      for (pos = 0; pos < length; pos += BLOCK_SECTOR_SIZE)
+        if (byte_to_sector (disk_inode, sector, pos, &pa) == 0)
+          {
+            release_sectors (disk_inode);
+            success = false;
+            break;
+          }
+      prealloc_release (&pa);
       free (disk_inode);
     }
   return success;
@@ -111,33 +345,64 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open, or was closed
+     recently. */
+  lock_acquire (&inode_table_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, elem);
+      if (inode->open_cnt == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->closed_elem);
+          closed_cnt--;
         }
+      inode->open_cnt++;
+
+      /* Another thread may still be reading it in. */
+      while (!inode->loaded)
+        cond_wait (&inode->loaded_cond, &inode_table_lock);
+      lock_release (&inode_table_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inode_table_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, and add the inode to the table before reading it,
+     so that other openers of the same sector find it and wait for
+     it instead of reading it again. */
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loaded = false;
+  cond_init (&inode->loaded_cond);
+  rwlock_init (&inode->rw);
+  inode->deny_write_cnt = 0;
+  prealloc_init (&inode->prealloc, sector);
+  rwlock_init (&inode->op_rw);
+  inode->aux = NULL;
+  inode->aux_destroy = NULL;
+  lock_release (&inode_table_lock);
+
+  /* Read the inode without the table lock held. */
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&inode_table_lock);
+  inode->loaded = true;
+  cond_broadcast (&inode->loaded_cond, &inode_table_lock);
+  lock_release (&inode_table_lock);
   return inode;
 }
 
@@ -146,7 +411,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -158,8 +427,10 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it in memory
+   for a while in case it is reopened.
+   If INODE was also a removed inode, frees its memory and its
+   blocks right away. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +438,76 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  /* Release resources if this was the last opener.  No other
+     thread can be using INODE then, so its lock is not needed. */
+  lock_acquire (&inode_table_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      prealloc_release (&inode->prealloc);
  
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  Once INODE is out of the
+         table, nothing else can find it, so its blocks are
+         released without the table lock held. */
       if (inode->removed) 
         {
+          hash_delete (&open_inodes, &inode->elem);
+          lock_release (&inode_table_lock);
+          release_sectors (&inode->data);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          free_inode (inode);
+          return;
         }
 
-      free (inode); 
+      /* Keep the inode, and free the one closed longest ago if
+         there are too many. */
+      list_push_front (&closed_inodes, &inode->closed_elem);
+      if (++closed_cnt > CLOSED_CNT)
+        {
+          struct list_elem *e = list_pop_back (&closed_inodes);
+          struct inode *oldest = list_entry (e, struct inode, closed_elem);
+          closed_cnt--;
+          hash_delete (&open_inodes, &oldest->elem);
+          free_inode (oldest);
+        }
     }
+  lock_release (&inode_table_lock);
+}
+
+/* Removes the closed inode for SECTOR from the inode table, if
+   it is there, so that the next inode_open() reads SECTOR again
+   instead of returning what used to be there.  No inode for
+   SECTOR may be open, since SECTOR is being reused. */
+static void
+forget_inode (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  lock_acquire (&inode_table_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
+    {
+      struct inode *inode = hash_entry (e, struct inode, elem);
+      ASSERT (inode->open_cnt == 0);
+      list_remove (&inode->closed_elem);
+      closed_cnt--;
+      hash_delete (&open_inodes, &inode->elem);
+      free_inode (inode);
+    }
+  lock_release (&inode_table_lock);
+}
+
+/* Destroys the data attached to INODE, which must not be open,
+   and frees INODE. */
+static void
+free_inode (struct inode *inode)
+{
+  ASSERT (inode->open_cnt == 0);
+
+  if (inode->aux_destroy != NULL)
+    inode->aux_destroy (inode->aux);
+  free (inode); 
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +516,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode_table_lock);
   inode->removed = true;
+  lock_release (&inode_table_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,16 +529,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (&inode->data, inode->sector,
+                                                  offset, NULL);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,23 +548,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Nothing has been written here yet. */
+          memset (buffer + bytes_read, 0, chunk_size);
         }
       
       /* Advance. */
@@ -244,75 +561,121 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
+/* Updates RA, the sequential access state of a file open on
+   INODE, for a read of SIZE bytes at OFFSET that was just done.
+   If the file is being read sequentially, asks the buffer cache
+   to read the following sectors ahead.  The read-ahead window
+   doubles with each further sequential read, up to
+   READ_AHEAD_MAX sectors, and closes on any other access. */
+void
+inode_read_ahead (struct inode *inode, struct inode_ra *ra,
+                  off_t size, off_t offset)
+{
+  off_t start, end, length, pos;
+
+  if (size <= 0)
+    return;
+
+  if (offset == ra->next)
+    {
+      ra->window *= 2;
+      if (ra->window < READ_AHEAD_MIN)
+        ra->window = READ_AHEAD_MIN;
+      else if (ra->window > READ_AHEAD_MAX)
+        ra->window = READ_AHEAD_MAX;
+    }
+  else
+    {
+      ra->window = 0;
+      ra->end = 0;
+    }
+  ra->next = offset + size;
+  if (ra->window == 0)
+    return;
+
+  /* Read ahead the sectors after the one the read ended in,
+     skipping any already requested. */
+  rwlock_acquire_read (&inode->rw);
+  start = ROUND_UP (ra->next, BLOCK_SECTOR_SIZE);
+  end = start + ra->window * BLOCK_SECTOR_SIZE;
+  length = inode->data.length;
+  if (end > length)
+    end = length;
+  if (start < ra->end)
+    start = ra->end;
+  for (pos = start; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (&inode->data, inode->sector,
+                                              pos, NULL);
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+  rwlock_release_read (&inode->rw);
+  if (end > ra->end)
+    ra->end = end;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or the file reaches its
+   maximum size.
+   A write past end of file extends the file.  Any gap between
+   the old end of file and OFFSET reads as zeros, and takes no
+   disk space until it is written. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  /* Writes take the lock exclusively, because they may allocate
+     sectors and change the length. */
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Sector to write, allocated if necessary, and starting
+         byte offset within sector. */
+      block_sector_t sector_idx = byte_to_sector (&inode->data, inode->sector,
+                                                  offset,
+                                                  &inode->prealloc);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file if we wrote past its end.  Only the length
+     field of the on-disk inode is written back. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write (inode->sector, &inode->data.length,
+                   offsetof (struct inode_disk, length),
+                   sizeof inode->data.length);
+    }
+  rwlock_release_write (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +685,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +697,122 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
+}
+
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir;
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Acquires INODE's operation lock, shared with other holders
+   in shared mode.  Lets another module, such as the directory
+   module, keep an operation that consists of several reads of
+   INODE from seeing a concurrent change made of several writes.
+   inode_read_at() and inode_write_at() do not take this lock
+   themselves, so it may be held across calls to them. */
+void
+inode_lock_shared (struct inode *inode)
+{
+  rwlock_acquire_read (&inode->op_rw);
+}
+
+/* Releases INODE's operation lock, acquired in shared mode. */
+void
+inode_unlock_shared (struct inode *inode)
+{
+  rwlock_release_read (&inode->op_rw);
+}
+
+/* Acquires INODE's operation lock in exclusive mode. */
+void
+inode_lock_exclusive (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->op_rw);
+}
+
+/* Releases INODE's operation lock, acquired in exclusive mode. */
+void
+inode_unlock_exclusive (struct inode *inode)
+{
+  rwlock_release_write (&inode->op_rw);
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode_table_lock);
+  removed = inode->removed;
+  lock_release (&inode_table_lock);
+  return removed;
+}
+
+/* Returns the sector that holds byte offset POS in INODE, or 0 if
+   none has been allocated there. */
+block_sector_t
+inode_byte_to_sector (struct inode *inode, off_t pos)
+{
+  block_sector_t sector;
+
+  rwlock_acquire_read (&inode->rw);
+  sector = byte_to_sector (&inode->data, inode->sector, pos, NULL);
+  rwlock_release_read (&inode->rw);
+  return sector;
+}
+
+/* Returns the length, in bytes, of INODE's data.  Another thread
+   may change it at any time, so the caller must be prepared for
+   it to be out of date. */
 off_t
 inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Attaches AUX to INODE, replacing any data attached before
+   without destroying it.  AUX stays attached as long as INODE is
+   in memory, and is then destroyed by calling DESTROY, if it is
+   nonnull, on it.  Lets other modules keep in-memory state for
+   an inode across opens of it.  The caller is responsible for
+   synchronizing access to AUX. */
+void
+inode_set_aux (struct inode *inode, void *aux,
+               inode_aux_destroy_func *destroy)
+{
+  inode->aux = aux;
+  inode->aux_destroy = destroy;
+}
+
+/* Returns the data attached to INODE, or a null pointer if there
+   is none. */
+void *
+inode_get_aux (const struct inode *inode)
+{
+  return inode->aux;
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
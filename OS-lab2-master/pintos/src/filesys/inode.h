@@ -7,17 +7,39 @@
 
 struct bitmap;
 
+/* Sequential access state of an open file, for read-ahead. */
+struct inode_ra
+  {
+    off_t next;                 /* Where a sequential read would start. */
+    off_t end;                  /* Read ahead requested up to here. */
+    int window;                 /* Sectors to read ahead, 0 for none. */
+  };
+
+/* Destroys AUX, data attached to an inode with inode_set_aux(). */
+typedef void inode_aux_destroy_func (void *aux);
+
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, struct inode_ra *,
+                       off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+block_sector_t inode_byte_to_sector (struct inode *, off_t);
+void inode_set_aux (struct inode *, void *aux, inode_aux_destroy_func *);
+void *inode_get_aux (const struct inode *);
+void inode_lock_shared (struct inode *);
+void inode_unlock_shared (struct inode *);
+void inode_lock_exclusive (struct inode *);
+void inode_unlock_exclusive (struct inode *);
 
 #endif /* filesys/inode.h */
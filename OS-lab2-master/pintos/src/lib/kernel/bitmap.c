@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -358,6 +359,22 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Copies the SIZE bytes of B that bitmap_write() would write at
+   offset OFS in a file, or as many of them as are within B's file
+   size, into BUFFER.  Returns the number of bytes copied. */
+size_t
+bitmap_get_bytes (const struct bitmap *b, void *buffer,
+                  size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+  if (ofs >= file_size)
+    return 0;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  memcpy (buffer, (const uint8_t *) b->bits + ofs, size);
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
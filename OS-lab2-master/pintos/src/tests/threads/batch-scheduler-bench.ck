@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The numbers depend on timing, so only check that every run reported.
+@output = get_core_output ("run", @output);
+fail "Missing \"begin\" or \"end\" message\n"
+  if $output[0] ne "(batch-scheduler-bench) begin"
+     || $output[$#output] ne "(batch-scheduler-bench) end";
+my ($runs) = scalar (grep (/^\(batch-scheduler-bench\) prio .*: makespan +\d+ /,
+			    @output));
+fail "Expected 36 benchmark runs, found $runs\n" if $runs != 36;
+pass;
@@ -13,4 +13,130 @@ void test_batch_scheduler (void)
 {
     init_bus ();
     batch_scheduler (3, 4, 3, 3);
+    report_bus_stats ();
+}
+
+/* Benchmark of the bus arbiter.
+ *
+ * Runs batches of BENCH_TASKS tasks for every combination of workload mix,
+ * bus capacity and transfer duration distribution below, and prints one line
+ * of results for each, so that arbiter policies can be compared on numbers.
+ * Durations are much shorter than in the exercise's workload, to keep the
+ * whole sweep within a minute or so.  init_bus () always seeds the random
+ * number generator with the same value, so each run reseeds it with its own
+ * index, to draw durations of its own that are still the same every time the
+ * test is run. */
+
+#define BENCH_TASKS 40
+
+/* Shares of priority tasks and, within each priority, of senders */
+struct bench_mix
+  {
+    int priority_pct;
+    int send_pct;
+  };
+
+static const struct bench_mix bench_mixes[] =
+  {
+    {0, 50}, {25, 50}, {25, 80}, {50, 50},
+  };
+
+static const unsigned bench_capacities[] = {1, 3, 6};
+
+static unsigned long uniform_duration (void);
+static unsigned long short_duration (void);
+static unsigned long bimodal_duration (void);
+
+struct bench_duration
+  {
+    const char *name;
+    duration_func *function;
+  };
+
+static const struct bench_duration bench_durations[] =
+  {
+    {"uniform", uniform_duration},
+    {"short", short_duration},
+    {"bimodal", bimodal_duration},
+  };
+
+static void format_waits (char *, size_t, direction_t, priority_t);
+
+void test_batch_scheduler_bench (void)
+{
+    size_t m, c, d;
+    unsigned run = 0;
+
+    msg ("%d tasks per run, waits in ticks as p50/p99", BENCH_TASKS);
+    for (m = 0; m < sizeof bench_mixes / sizeof *bench_mixes; m++)
+      for (c = 0; c < sizeof bench_capacities / sizeof *bench_capacities; c++)
+        for (d = 0; d < sizeof bench_durations / sizeof *bench_durations; d++)
+          {
+            const struct bench_mix *mix = &bench_mixes[m];
+            unsigned prio = BENCH_TASKS * mix->priority_pct / 100;
+            unsigned normal = BENCH_TASKS - prio;
+            unsigned prio_send = prio * mix->send_pct / 100;
+            unsigned normal_send = normal * mix->send_pct / 100;
+            char waits[NUM_OF_DIRECTIONS][NUM_OF_PRIORITIES][24];
+            int dir, pri;
+
+            init_bus ();
+            random_init (++run);
+            set_bus_capacity (bench_capacities[c]);
+            set_transfer_duration (bench_durations[d].function);
+            batch_scheduler (prio_send, prio - prio_send,
+                             normal_send, normal - normal_send);
+
+            for (dir = 0; dir < NUM_OF_DIRECTIONS; dir++)
+              for (pri = 0; pri < NUM_OF_PRIORITIES; pri++)
+                format_waits (waits[dir][pri], sizeof waits[dir][pri],
+                              dir, pri);
+            msg ("prio %2d%% send %2d%% cap %u %-7s: makespan %4lld "
+                 "util %3d%% switches %2u; sender-prio %s receiver-prio %s "
+                 "sender %s receiver %s",
+                 mix->priority_pct, mix->send_pct, bench_capacities[c],
+                 bench_durations[d].name, makespan, bus_utilization (),
+                 direction_switches,
+                 waits[SEND][PRIORITY], waits[RECEIVE][PRIORITY],
+                 waits[SEND][NORMAL], waits[RECEIVE][NORMAL]);
+          }
+}
+
+/* Transfer durations spread evenly over 0...19 ticks */
+static unsigned long
+uniform_duration (void)
+{
+    return random_ulong () % 20;
+}
+
+/* Transfer durations of 0...3 ticks, so that arbitration dominates */
+static unsigned long
+short_duration (void)
+{
+    return random_ulong () % 4;
+}
+
+/* Mostly short transfers, with one in ten taking 40...49 ticks */
+static unsigned long
+bimodal_duration (void)
+{
+    if (random_ulong () % 10 == 0)
+      return 40 + random_ulong () % 10;
+    return random_ulong () % 4;
+}
+
+/* Formats the p50 and p99 waits of the latest batch's tasks of the given
+ * DIRECTION and PRIORITY into the SIZE bytes at BUF, or "-" if there were no
+ * such tasks */
+static void
+format_waits (char *buf, size_t size, direction_t direction,
+              priority_t priority)
+{
+    int64_t p50 = wait_percentile (direction, priority, 50);
+    int64_t p99 = wait_percentile (direction, priority, 99);
+
+    if (p50 < 0)
+      snprintf (buf, size, "-");
+    else
+      snprintf (buf, size, "%lld/%lld", p50, p99);
 }
@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
     {"batch-scheduler", test_batch_scheduler},
+    {"batch-scheduler-bench", test_batch_scheduler_bench},
   };
 
 static const char *test_name;
@@ -13,6 +13,7 @@ extern test_func test_alarm_negative;
 /*extern test_func test_producer_consumer;
 extern test_func test_narrow_bridge;*/
 extern test_func test_batch_scheduler;
+extern test_func test_batch_scheduler_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
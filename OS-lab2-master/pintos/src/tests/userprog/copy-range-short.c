@@ -0,0 +1,22 @@
+/* Copies into the running executable, which cannot be
+   modified.  copy_file_range must copy nothing and leave the
+   source file's position where it was, so that no bytes are
+   lost. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int in, out;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((out = open ("copy-range-short")) > 1,
+         "open \"copy-range-short\"");
+  CHECK (copy_file_range (in, out, sizeof sample - 1) == 0,
+         "try to copy into \"copy-range-short\"");
+  CHECK (tell (in) == 0, "tell \"sample.txt\"");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range-short) begin
+(copy-range-short) open "sample.txt"
+(copy-range-short) open "copy-range-short"
+(copy-range-short) try to copy into "copy-range-short"
+(copy-range-short) tell "sample.txt"
+(copy-range-short) end
+copy-range-short: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Copies "sample.txt" to the console with copy_file_range. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (copy_file_range (handle, STDOUT_FILENO, sizeof sample - 1)
+         == sizeof sample - 1, "copy \"sample.txt\" to stdout");
+}
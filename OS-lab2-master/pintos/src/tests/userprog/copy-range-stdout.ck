@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range-stdout) begin
+(copy-range-stdout) open "sample.txt"
+(copy-range-stdout) copy "sample.txt" to stdout
+"Amazing Electronic Fact: If you scuffed your feet long enough without
+ touching anything, you would build up so many electrons that your
+ finger would explode!  But this is nothing to worry about unless you
+ have carpeting." --Dave Barry
+(copy-range-stdout) end
+copy-range-stdout: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Tries to duplicate invalid file descriptors, which must fail
+   with -1. */
+
+#include <limits.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (dup (0x20101234) == -1, "dup 0x20101234");
+  CHECK (dup (5) == -1, "dup 5");
+  CHECK (dup (-1) == -1, "dup -1");
+  CHECK (dup (INT_MIN) == -1, "dup INT_MIN");
+  CHECK (dup (INT_MAX) == -1, "dup INT_MAX");
+}
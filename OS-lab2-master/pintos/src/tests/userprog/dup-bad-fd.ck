@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup-bad-fd) begin
+(dup-bad-fd) dup 0x20101234
+(dup-bad-fd) dup 5
+(dup-bad-fd) dup -1
+(dup-bad-fd) dup INT_MIN
+(dup-bad-fd) dup INT_MAX
+(dup-bad-fd) end
+dup-bad-fd: exit(0)
+EOF
+pass;
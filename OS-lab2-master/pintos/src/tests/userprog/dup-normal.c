@@ -0,0 +1,28 @@
+/* Duplicates a descriptor with dup and checks that both
+   descriptors share the file's position, and that the file stays
+   open through one descriptor after the other is closed. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buffer[sizeof sample - 1];
+  int handle, copy;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((copy = dup (handle)) > 1, "dup \"sample.txt\"");
+  if (copy == handle)
+    fail ("dup() returned the descriptor it was given");
+
+  CHECK (read (handle, buffer, 10) == 10, "read 10 bytes from original");
+  CHECK (tell (copy) == 10, "tell copy");
+  msg ("close original");
+  close (handle);
+  CHECK (read (copy, buffer + 10, sizeof buffer - 10)
+         == (int) sizeof buffer - 10, "read the rest from copy");
+  compare_bytes (buffer, sample, sizeof buffer, 0, "sample.txt");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup-normal) begin
+(dup-normal) open "sample.txt"
+(dup-normal) dup "sample.txt"
+(dup-normal) read 10 bytes from original
+(dup-normal) tell copy
+(dup-normal) close original
+(dup-normal) read the rest from copy
+(dup-normal) end
+dup-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Passes buffer counts outside [0, IOV_MAX] to readv, which must
+   fail with -1 without reading anything. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[IOV_MAX + 1];
+  char buf;
+  int handle;
+  int i;
+
+  for (i = 0; i < IOV_MAX + 1; i++)
+    {
+      iov[i].iov_base = &buf;
+      iov[i].iov_len = 1;
+    }
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (readv (handle, iov, IOV_MAX + 1) == -1,
+         "readv with %d buffers", IOV_MAX + 1);
+  CHECK (readv (handle, iov, -1) == -1, "readv with -1 buffers");
+  CHECK (tell (handle) == 0, "tell \"sample.txt\"");
+}
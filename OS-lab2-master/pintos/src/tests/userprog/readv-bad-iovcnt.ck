@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-bad-iovcnt) begin
+(readv-bad-iovcnt) open "sample.txt"
+(readv-bad-iovcnt) readv with 17 buffers
+(readv-bad-iovcnt) readv with -1 buffers
+(readv-bad-iovcnt) tell "sample.txt"
+(readv-bad-iovcnt) end
+readv-bad-iovcnt: exit(0)
+EOF
+pass;
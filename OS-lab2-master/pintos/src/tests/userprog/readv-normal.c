@@ -0,0 +1,41 @@
+/* Reads "sample.txt" with readv into three buffers, the second
+   of which is longer than what is left of the file.  readv must
+   stop at that short read and leave the third buffer alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char head[10];
+static char tail[sizeof sample];
+static char extra[16];
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  int handle, byte_cnt;
+  size_t i;
+
+  memset (extra, 0xcc, sizeof extra);
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof head;
+  iov[1].iov_base = tail;
+  iov[1].iov_len = sizeof tail;
+  iov[2].iov_base = extra;
+  iov[2].iov_len = sizeof extra;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  compare_bytes (head, sample, sizeof head, 0, "sample.txt");
+  compare_bytes (tail, sample + sizeof head, sizeof sample - 1 - sizeof head,
+                 sizeof head, "sample.txt");
+  for (i = 0; i < sizeof extra; i++)
+    if (extra[i] != (char) 0xcc)
+      fail ("readv() wrote past the first short read");
+}
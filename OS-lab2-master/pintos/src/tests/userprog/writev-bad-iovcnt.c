@@ -0,0 +1,24 @@
+/* Passes buffer counts outside [0, IOV_MAX] to writev, which must
+   fail with -1 without writing anything. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[IOV_MAX + 1];
+  int i;
+
+  for (i = 0; i < IOV_MAX + 1; i++)
+    {
+      iov[i].iov_base = "x";
+      iov[i].iov_len = 1;
+    }
+
+  CHECK (writev (STDOUT_FILENO, iov, IOV_MAX + 1) == -1,
+         "writev with %d buffers", IOV_MAX + 1);
+  CHECK (writev (STDOUT_FILENO, iov, -1) == -1, "writev with -1 buffers");
+}
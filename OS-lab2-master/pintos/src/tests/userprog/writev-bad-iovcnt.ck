@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-bad-iovcnt) begin
+(writev-bad-iovcnt) writev with 17 buffers
+(writev-bad-iovcnt) writev with -1 buffers
+(writev-bad-iovcnt) end
+writev-bad-iovcnt: exit(0)
+EOF
+pass;
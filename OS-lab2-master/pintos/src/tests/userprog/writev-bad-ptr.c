@@ -0,0 +1,21 @@
+/* Passes a buffer array whose one buffer is an invalid pointer
+   to the writev system call.  The process must be terminated
+   with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov;
+  int handle;
+
+  iov.iov_base = (char *) 0x10123420;
+  iov.iov_len = 123;
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  writev (handle, &iov, 1);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,24 @@
+/* Writes three buffers to the console with one writev call. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  int byte_cnt;
+
+  iov[0].iov_base = "Hello, ";
+  iov[0].iov_len = 7;
+  iov[1].iov_base = "world";
+  iov[1].iov_len = 5;
+  iov[2].iov_base = "!\n";
+  iov[2].iov_len = 2;
+
+  byte_cnt = writev (STDOUT_FILENO, iov, 3);
+  if (byte_cnt != 14)
+    fail ("writev() returned %d instead of 14", byte_cnt);
+}
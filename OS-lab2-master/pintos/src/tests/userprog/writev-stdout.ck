@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-stdout) begin
+Hello, world!
+(writev-stdout) end
+writev-stdout: exit(0)
+EOF
+pass;
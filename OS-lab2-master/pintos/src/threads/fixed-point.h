@@ -0,0 +1,100 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed fixed-point real numbers in 17.14 format: 17 bits
+   before the binary point, 14 after it, and a sign bit.  Used by
+   the multi-level feedback queue scheduler, since the kernel
+   does not use floating point.
+
+   Integer arguments and results are plain ints.  Mixing up
+   fixed-point values and ints is not caught by the compiler, so
+   the fix_ prefix marks every function that returns or takes a
+   fixed-point value. */
+typedef int fixed_t;
+
+/* Number of fraction bits. */
+#define FIX_SHIFT 14
+
+/* Fixed-point representation of 1. */
+#define FIX_ONE (1 << FIX_SHIFT)
+
+/* Returns integer N as a fixed-point number. */
+static inline fixed_t
+fix_int (int n)
+{
+  return n * FIX_ONE;
+}
+
+/* Returns N / D as a fixed-point number, for integers N and D. */
+static inline fixed_t
+fix_frac (int n, int d)
+{
+  return n * FIX_ONE / d;
+}
+
+/* Returns X rounded toward zero to an integer. */
+static inline int
+fix_trunc (fixed_t x)
+{
+  return x / FIX_ONE;
+}
+
+/* Returns X rounded to the nearest integer. */
+static inline int
+fix_round (fixed_t x)
+{
+  return x >= 0 ? (x + FIX_ONE / 2) / FIX_ONE : (x - FIX_ONE / 2) / FIX_ONE;
+}
+
+/* Returns X + Y. */
+static inline fixed_t
+fix_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_t
+fix_add_int (fixed_t x, int n)
+{
+  return x + n * FIX_ONE;
+}
+
+/* Returns X - Y. */
+static inline fixed_t
+fix_sub (fixed_t x, fixed_t y)
+{
+  return x - y;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fix_mul (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * y / FIX_ONE;
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_t
+fix_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fix_div (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * FIX_ONE / y;
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_t
+fix_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -0,0 +1,223 @@
+#include "threads/sched-trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Scheduler event tracing.
+
+   Events are stored in a fixed-size ring, so that tracing costs
+   a few stores per event and never allocates memory.  Once the
+   ring is full, each new event overwrites the oldest one.  At
+   shutdown, the events still in the ring are summarized per
+   thread name, with a histogram of wakeup latencies, that is,
+   of the time from thread_unblock() to the thread's first run
+   afterward.
+
+   Times come from the CPU's time-stamp counter, which is cheap
+   to read and much finer than a timer tick.  They are converted
+   to microseconds only when the ring is dumped, by comparing the
+   time-stamp counter to the timer tick count. */
+
+/* Number of events kept in the ring. */
+#define SCHED_TRACE_SIZE 512
+
+/* Number of distinct thread names summarized by
+   sched_trace_dump().  Any further names are lumped together. */
+#define NAME_CNT 32
+
+/* Number of wakeup latency histogram buckets.  Bucket 0 counts
+   latencies under 1 us, bucket B counts latencies of at least
+   2**(B-1) us, and under 2**B us except for the last bucket. */
+#define HIST_BUCKETS 16
+
+/* One recorded event. */
+struct sched_trace_entry
+  {
+    uint64_t time;              /* Time-stamp counter at event. */
+    uint32_t latency;           /* SCHED_SWITCH: wakeup latency. */
+    tid_t tid;                  /* Thread's identifier. */
+    enum sched_event event;     /* What happened. */
+    char name[16];              /* Thread's name. */
+  };
+
+/* Per-name summary built by sched_trace_dump(). */
+struct sched_trace_summary
+  {
+    char name[16];              /* Thread name. */
+    unsigned events[3];         /* Count of each enum sched_event. */
+    unsigned hist[HIST_BUCKETS];/* Wakeup latency histogram. */
+    uint32_t max_latency;       /* Longest wakeup latency. */
+  };
+
+/* If false (default), scheduler events are not recorded.
+   If true, they are recorded and dumped at shutdown.
+   Controlled by kernel command-line option "-sched-trace". */
+bool sched_trace_enabled;
+
+static struct sched_trace_entry *ring;  /* Ring, null if inactive. */
+static unsigned ring_head;              /* Index of next entry to use. */
+static long long recorded_cnt;          /* # of events ever recorded. */
+static uint64_t start_time;             /* Counter at sched_trace_init(). */
+static int64_t start_ticks;             /* Ticks at sched_trace_init(). */
+
+static struct sched_trace_summary *find_summary (struct sched_trace_summary *,
+                                                 const char *name);
+
+/* Allocates the trace ring, if tracing was requested on the
+   kernel command line.  Events that happen before this is called
+   are not recorded.  The page allocator must be initialized. */
+void
+sched_trace_init (void)
+{
+  if (!sched_trace_enabled)
+    return;
+
+  ring = palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (SCHED_TRACE_SIZE
+                                                      * sizeof *ring,
+                                                      PGSIZE));
+  if (ring == NULL)
+    {
+      printf ("sched-trace: out of memory, tracing disabled\n");
+      sched_trace_enabled = false;
+      return;
+    }
+  start_time = read_tsc ();
+  start_ticks = timer_ticks ();
+}
+
+/* Records EVENT for thread T.  Interrupts must be off.
+   Callers should check sched_trace_enabled first, to keep the
+   cost of disabled tracing to a single test. */
+void
+sched_trace_record (enum sched_event event, struct thread *t)
+{
+  struct sched_trace_entry *e;
+  uint64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (ring == NULL)
+    return;
+
+  now = read_tsc ();
+  e = &ring[ring_head];
+  ring_head = (ring_head + 1) % SCHED_TRACE_SIZE;
+  recorded_cnt++;
+
+  e->time = now;
+  e->latency = 0;
+  e->tid = t->tid;
+  e->event = event;
+  memcpy (e->name, t->name, sizeof e->name);
+
+  if (event == SCHED_UNBLOCK)
+    t->trace_ready_time = now;
+  else if (event == SCHED_SWITCH && t->trace_ready_time != 0)
+    {
+      uint64_t latency = now - t->trace_ready_time;
+      e->latency = latency < UINT32_MAX ? latency : UINT32_MAX;
+      t->trace_ready_time = 0;
+    }
+}
+
+/* Prints a summary of the events in the trace ring, per thread
+   name, if tracing is active. */
+void
+sched_trace_dump (void)
+{
+  struct sched_trace_summary *summaries;
+  uint64_t cycles_per_us;
+  int64_t elapsed_ticks;
+  unsigned kept, i;
+  enum intr_level old_level;
+
+  if (ring == NULL)
+    return;
+
+  summaries = calloc (NAME_CNT, sizeof *summaries);
+  if (summaries == NULL)
+    return;
+
+  /* Stop recording while we look at the ring. */
+  old_level = intr_disable ();
+  elapsed_ticks = timer_ticks () - start_ticks;
+  cycles_per_us = 0;
+  if (elapsed_ticks > 0)
+    cycles_per_us = ((read_tsc () - start_time)
+                     / (elapsed_ticks * (1000000 / TIMER_FREQ)));
+  if (cycles_per_us == 0)
+    cycles_per_us = 1;
+
+  kept = recorded_cnt < SCHED_TRACE_SIZE ? recorded_cnt : SCHED_TRACE_SIZE;
+  for (i = 0; i < kept; i++)
+    {
+      const struct sched_trace_entry *e = &ring[i];
+      struct sched_trace_summary *s = find_summary (summaries, e->name);
+
+      s->events[e->event]++;
+      if (e->event == SCHED_SWITCH && e->latency != 0)
+        {
+          uint32_t us = e->latency / cycles_per_us;
+          int bucket = 0;
+
+          while (us >> bucket != 0 && bucket < HIST_BUCKETS - 1)
+            bucket++;
+          s->hist[bucket]++;
+          if (us > s->max_latency)
+            s->max_latency = us;
+        }
+    }
+  intr_set_level (old_level);
+
+  printf ("Sched trace: %lld events recorded, last %u shown, "
+          "wakeup latencies in us\n", recorded_cnt, kept);
+  for (i = 0; i < NAME_CNT && summaries[i].name[0] != '\0'; i++)
+    {
+      const struct sched_trace_summary *s = &summaries[i];
+      int b;
+
+      printf ("  %-15s %u switch %u block %u unblock;",
+              s->name, s->events[SCHED_SWITCH], s->events[SCHED_BLOCK],
+              s->events[SCHED_UNBLOCK]);
+      for (b = 0; b < HIST_BUCKETS; b++)
+        if (s->hist[b] != 0)
+          {
+            if (b == 0)
+              printf (" <1:%u", s->hist[b]);
+            else
+              printf (" %u+:%u", 1u << (b - 1), s->hist[b]);
+          }
+      printf (" max %"PRIu32"\n", s->max_latency);
+    }
+
+  free (summaries);
+}
+
+/* Returns the summary in SUMMARIES for thread NAME, claiming a
+   free one if NAME has none yet.  Once all NAME_CNT summaries are
+   in use, the last one collects every other name. */
+static struct sched_trace_summary *
+find_summary (struct sched_trace_summary *summaries, const char *name)
+{
+  int i;
+
+  for (i = 0; i < NAME_CNT - 1; i++)
+    {
+      struct sched_trace_summary *s = &summaries[i];
+      if (s->name[0] == '\0')
+        strlcpy (s->name, name, sizeof s->name);
+      if (!strcmp (s->name, name))
+        return s;
+    }
+  strlcpy (summaries[i].name, "(other)", sizeof summaries[i].name);
+  return &summaries[i];
+}
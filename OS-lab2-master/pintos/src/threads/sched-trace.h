@@ -0,0 +1,25 @@
+#ifndef THREADS_SCHED_TRACE_H
+#define THREADS_SCHED_TRACE_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Scheduler events recorded in the trace ring. */
+enum sched_event
+  {
+    SCHED_SWITCH,               /* Thread switched in. */
+    SCHED_BLOCK,                /* Running thread blocked. */
+    SCHED_UNBLOCK               /* Blocked thread made ready. */
+  };
+
+/* If false (default), scheduler events are not recorded.
+   If true, they are recorded and dumped at shutdown.
+   Controlled by kernel command-line option "-sched-trace". */
+extern bool sched_trace_enabled;
+
+void sched_trace_init (void);
+void sched_trace_record (enum sched_event, struct thread *);
+void sched_trace_dump (void);
+
+#endif /* threads/sched-trace.h */
@@ -31,6 +31,31 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Maximum length of a chain of nested priority donations, that
+   is, of threads each waiting on a lock held by the next. */
+#define DONATION_DEPTH_MAX 8
+
+/* Number of locks that lock_profile() can collect statistics
+   for.  Locks named after that many are not profiled. */
+#define LOCK_STATS_CNT 32
+
+/* If false (default), locks are not profiled.
+   If true, locks named with lock_profile() collect statistics,
+   which are printed at shutdown.
+   Controlled by kernel command-line option "-lock-stats". */
+bool lock_profiling;
+
+/* Statistics handed out by lock_profile(). */
+static struct lock_stats stats_pool[LOCK_STATS_CNT];
+static size_t stats_cnt;
+
+static bool priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
+static void donate_priority (struct thread *);
+static void record_acquire (struct lock_stats *, uint64_t wait_start);
+static void record_release (struct lock_stats *);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -102,7 +127,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  If the awakened thread has a higher priority than the running
+   thread, yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +141,20 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e;
+
+      if (thread_mlfqs)
+        for (e = list_begin (&sema->waiters); e != list_end (&sema->waiters);
+             e = list_next (e))
+          thread_mlfqs_refresh (list_entry (e, struct thread, elem));
+      e = list_max (&sema->waiters, priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,7 +208,13 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Because a lock has an owner, a thread that waits for a lock
+   donates its priority to the holder, and through it to the
+   holder of any lock that the holder is itself waiting for,
+   up to DONATION_DEPTH_MAX levels deep.  The multi-level
+   feedback queue scheduler does not use donation. */
 void
 lock_init (struct lock *lock)
 {
@@ -179,12 +222,17 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->stats = NULL;
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   Most locks are free most of the time, so an uncontended
+   acquisition takes LOCK directly, without going through
+   sema_down().
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +240,44 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  uint64_t wait_start = 0;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  if (lock->semaphore.value > 0 && list_empty (&lock->semaphore.waiters))
+    {
+      /* Nobody holds LOCK or waits for it, so there is no one
+         to donate priority to and no one to take donations
+         from. */
+      lock->semaphore.value--;
+      lock->holder = cur;
+      list_push_back (&cur->held_locks, &lock->elem);
+    }
+  else
+    {
+      if (lock->stats != NULL)
+        wait_start = read_tsc ();
+      if (lock->holder != NULL && !thread_mlfqs)
+        {
+          cur->waiting_lock = lock;
+          donate_priority (cur);
+        }
+      sema_down (&lock->semaphore);
+      cur->waiting_lock = NULL;
+      lock->holder = cur;
+      list_push_back (&cur->held_locks, &lock->elem);
+
+      /* Threads still waiting for LOCK now donate to us. */
+      thread_recompute_priority (cur);
+    }
+  if (lock->stats != NULL)
+    record_acquire (lock->stats, wait_start);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +296,22 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+      if (lock->stats != NULL)
+        record_acquire (lock->stats, 0);
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   The current thread gives up any priority donated through LOCK,
+   but keeps donations received through other locks it holds.
+   If no thread waits for LOCK, there is nothing to give up and
+   no one to wake, so LOCK is simply marked free.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +319,25 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->stats != NULL)
+    record_release (lock->stats);
   lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  list_remove (&lock->elem);
+  if (list_empty (&lock->semaphore.waiters))
+    lock->semaphore.value++;
+  else
+    {
+      thread_recompute_priority (cur);
+      sema_up (&lock->semaphore);
+    }
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -245,14 +350,114 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Starts collecting contention statistics for LOCK under the
+   given NAME, which must stay valid, if lock profiling is
+   enabled.  Should be called right after lock_init(). */
+void
+lock_profile (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  if (!lock_profiling)
+    return;
+
+  old_level = intr_disable ();
+  if (lock->stats == NULL && stats_cnt < LOCK_STATS_CNT)
+    {
+      lock->stats = &stats_pool[stats_cnt++];
+      lock->stats->name = name;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the statistics of the profiled locks. */
+void
+lock_print_stats (void)
+{
+  size_t i;
+
+  if (stats_cnt == 0)
+    return;
+
+  printf ("Lock stats: times in CPU cycles\n");
+  for (i = 0; i < stats_cnt; i++)
+    {
+      struct lock_stats s;
+      enum intr_level old_level;
+
+      /* Printing may itself take a profiled lock, so take a
+         snapshot first. */
+      old_level = intr_disable ();
+      s = stats_pool[i];
+      intr_set_level (old_level);
+
+      printf ("  %-12s %llu acquired, %llu contended; "
+              "wait avg %llu max %llu; hold avg %llu max %llu\n",
+              s.name, s.acquire_cnt, s.contended_cnt,
+              s.contended_cnt ? s.wait_cycles / s.contended_cnt : 0,
+              s.max_wait_cycles,
+              s.acquire_cnt ? s.hold_cycles / s.acquire_cnt : 0,
+              s.max_hold_cycles);
+    }
+}
+
+/* Counts an acquisition of the lock with statistics S, which
+   waited from time WAIT_START, or not at all if WAIT_START is 0.
+   Interrupts must be off. */
+static void
+record_acquire (struct lock_stats *s, uint64_t wait_start)
+{
+  uint64_t now = read_tsc ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  s->acquire_cnt++;
+  if (wait_start != 0)
+    {
+      uint64_t wait = now - wait_start;
+
+      s->contended_cnt++;
+      s->wait_cycles += wait;
+      if (wait > s->max_wait_cycles)
+        s->max_wait_cycles = wait;
+    }
+  s->acquire_time = now;
+}
+
+/* Counts a release of the lock with statistics S.  Interrupts
+   must be off. */
+static void
+record_release (struct lock_stats *s)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* The lock may have been held when it was profiled. */
+  if (s->acquire_time != 0)
+    {
+      uint64_t hold = read_tsc () - s->acquire_time;
+
+      s->hold_cycles += hold;
+      if (hold > s->max_hold_cycles)
+        s->max_hold_cycles = hold;
+      s->acquire_time = 0;
+    }
+}
 
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+static bool waiter_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +500,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,7 +508,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +524,20 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e;
+      enum intr_level old_level = intr_disable ();
+
+      if (thread_mlfqs)
+        for (e = list_begin (&cond->waiters); e != list_end (&cond->waiters);
+             e = list_next (e))
+          thread_mlfqs_refresh (list_entry (e, struct semaphore_elem,
+                                            elem)->thread);
+      e = list_max (&cond->waiters, waiter_priority_less, NULL);
+      list_remove (e);
+      intr_set_level (old_level);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +555,124 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.  A waiting writer keeps
+   new readers from entering, so that a steady stream of readers
+   cannot starve writers.  Unlike a lock, RW may be released by a
+   thread other than the one that acquired it, and its holders do
+   not receive priority donations. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->reader_cnt = 0;
+  rw->waiting_writer_cnt = 0;
+  rw->writing = false;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  while (rw->writing || rw->waiting_writer_cnt > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the caller acquired for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or other
+   writer holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  rw->waiting_writer_cnt++;
+  while (rw->writing || rw->reader_cnt > 0)
+    cond_wait (&rw->writers_ok, &rw->lock);
+  rw->waiting_writer_cnt--;
+  rw->writing = true;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the caller acquired for writing.  Prefers
+   handing RW to another writer, if one is waiting, and otherwise
+   lets in all the waiting readers. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writing);
+  rw->writing = false;
+  if (rw->waiting_writer_cnt > 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the thread that owns list element A has a
+   lower priority than the one that owns B. */
+static bool
+priority_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Returns true if the thread waiting on condition variable
+   waiter A has a lower priority than the one waiting on B. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED) 
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
+/* Donates T's priority to the holder of the lock that T is
+   waiting for, then to the holder of the lock that thread is
+   waiting for, and so on, stopping at the first holder that
+   already has at least T's priority or after DONATION_DEPTH_MAX
+   steps.  Interrupts must be off. */
+static void
+donate_priority (struct thread *t) 
+{
+  struct lock *lock = t->waiting_lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      thread_change_priority (holder, t->priority);
+      lock = holder->waiting_lock;
+    }
+}
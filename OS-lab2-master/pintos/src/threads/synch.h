@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -20,15 +21,39 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+    struct lock_stats *stats;   /* Contention statistics, or null. */
   };
 
+/* Contention statistics for a lock named with lock_profile().
+   Times are in CPU cycles. */
+struct lock_stats
+  {
+    const char *name;           /* Name given to lock_profile(). */
+    unsigned long long acquire_cnt;   /* Times acquired. */
+    unsigned long long contended_cnt; /* Times the acquirer waited. */
+    uint64_t wait_cycles;       /* Total time spent waiting. */
+    uint64_t max_wait_cycles;   /* Longest wait. */
+    uint64_t hold_cycles;       /* Total time held. */
+    uint64_t max_hold_cycles;   /* Longest hold. */
+    uint64_t acquire_time;      /* Time of the latest acquisition. */
+  };
+
+/* If false (default), locks are not profiled.
+   If true, locks named with lock_profile() collect statistics,
+   which are printed at shutdown.
+   Controlled by kernel command-line option "-lock-stats". */
+extern bool lock_profiling;
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_profile (struct lock *, const char *name);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -41,6 +66,23 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writers_ok; /* Signaled when a writer may enter. */
+    int reader_cnt;             /* Number of readers holding the lock. */
+    int waiting_writer_cnt;     /* Number of writers waiting. */
+    bool writing;               /* True if a writer holds the lock. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -8,9 +8,11 @@
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/sched-trace.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,9 +22,13 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Lists of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running, one list per
+   priority.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so the highest-priority ready
+   thread can be found without looking at any list. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -59,6 +65,23 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.
+
+   Once per second, recent_cpu decays for every thread, by a
+   factor that depends on the load average.  Running and ready
+   threads are updated right away, but blocked threads are only
+   brought up to date when they become ready again (see
+   mlfqs_catch_up()), so that the per-second work is proportional
+   to the number of ready threads, not to the number of threads.
+   To make that possible, the decay factors of the last
+   DECAY_HISTORY seconds are remembered. */
+#define DECAY_HISTORY 64        /* # of seconds of decay factors kept. */
+#define PRIORITY_INTERVAL 4     /* # of ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+static int64_t mlfqs_seconds;   /* # of per-second updates done. */
+static fixed_t decay_history[DECAY_HISTORY]; /* Recent decay factors. */
+static int ready_cnt;           /* # of threads in the ready queues. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -67,6 +90,14 @@ static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static struct thread *ready_pop (void);
+static int ready_max_priority (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_second (void);
+static void mlfqs_catch_up (struct thread *);
+static int mlfqs_priority (const struct thread *);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
@@ -87,10 +118,15 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_profile (&tid_lock, "tid");
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
+  ready_mask = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -117,14 +153,6 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-void update_sleeping_threads(struct thread *t, void *aux) {
-    int64_t now = *(int64_t *)aux;
-    if (t->status == THREAD_BLOCKED && t->wakeup_time > 0 && t->wakeup_time <= now) {
-        t->wakeup_time = 0;
-        thread_unblock(t);
-    }
-}
-
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
@@ -142,6 +170,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -167,9 +198,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the new thread preempts it before thread_create()
+   returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -216,6 +247,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_yield_to_higher ();
 
   return tid;
 }
@@ -233,6 +265,8 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   thread_current ()->status = THREAD_BLOCKED;
+  if (sched_trace_enabled)
+    sched_trace_record (SCHED_BLOCK, thread_current ());
   schedule ();
 }
 
@@ -243,7 +277,11 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Callers that want T to run right away if
+   it outranks them should call thread_yield_to_higher()
+   afterward.  The exception is an interrupt handler, which
+   cannot yield: there, a higher-priority T makes the interrupted
+   thread yield when the handler returns. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -253,8 +291,14 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_mlfqs)
+    mlfqs_catch_up (t);
+  ready_push (t);
   t->status = THREAD_READY;
+  if (sched_trace_enabled)
+    sched_trace_record (SCHED_UNBLOCK, t);
+  if (intr_context () && t->priority > thread_current ()->priority)
+    intr_yield_on_return ();
   intr_set_level (old_level);
 }
 
@@ -324,12 +368,33 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  In an interrupt handler, arranges for the
+   yield to happen when the handler returns instead. */
+void
+thread_yield_to_higher (void) 
+{
+  enum intr_level old_level;
+  bool preempt;
+
+  old_level = intr_disable ();
+  preempt = ready_max_priority () > thread_current ()->priority;
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -347,11 +412,89 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if the current thread no longer has the highest
+   priority.  Priority donated to the current thread through
+   locks it holds stays in effect until those locks are
+   released.
+
+   The multi-level feedback queue scheduler computes priorities
+   on its own, so this function does nothing if it is in use. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_recompute_priority (cur);
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching ready queue if it is ready to run.  Does not yield;
+   use thread_yield_to_higher() for that.  Interrupts must be
+   off. */
+void
+thread_change_priority (struct thread *t, int priority) 
+{
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority == priority)
+    return;
+
+  if (t->status == THREAD_READY && t != idle_thread)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes T's effective priority as the greater of its base
+   priority and the priorities of the threads waiting for locks
+   that T holds.  There is no donation under the multi-level
+   feedback queue scheduler, so then this does nothing.
+   Interrupts must be off. */
+void
+thread_recompute_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+  struct list_elem *e, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+
+  thread_change_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -361,35 +504,68 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Brings blocked thread T's recent_cpu and priority up to date
+   with the multi-level feedback queue scheduler's per-second
+   updates, so that its priority can be compared with those of
+   running and ready threads.  Does nothing for other threads or
+   other schedulers.  Interrupts must be off. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_mlfqs_refresh (struct thread *t) 
 {
-  /* Not yet implemented. */
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs && t->status == THREAD_BLOCKED)
+    mlfqs_catch_up (t);
+}
+
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
+void
+thread_set_nice (int nice) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    cur->priority = mlfqs_priority (cur);
+  intr_set_level (old_level);
+
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fix_round (fix_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fix_round (fix_mul_int (thread_current ()->recent_cpu,
+                                               100));
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -399,7 +575,7 @@ thread_get_recent_cpu (void)
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
+   ready queues.  It is returned by next_thread_to_run() as a
    special case when the ready list is empty. */
 static void
 idle (void *idle_started_ UNUSED) 
@@ -414,6 +590,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* With tickless idle, don't take timer interrupts that
+         have nothing to wake up. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -475,9 +655,24 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+#ifdef USERPROG
+  list_init (&t->children);
+#endif
   t->magic = THREAD_MAGIC;
-  t->wakeup_time = 0;
+
+  /* New threads inherit their creator's niceness and recent CPU
+     time.  The initial thread starts out with zeros. */
+  if (t != running_thread ())
+    {
+      struct thread *parent = running_thread ();
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+    }
+  t->cpu_epoch = mlfqs_seconds;
+  if (thread_mlfqs)
+    t->priority = mlfqs_priority (t);
   list_push_back (&all_list, &t->allelem);
 }
 
@@ -494,18 +689,200 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns the index of the most significant set bit in MASK,
+   which must be nonzero.  Splitting MASK into 32-bit halves
+   keeps GCC from calling out to a libgcc helper that the kernel
+   doesn't link against. */
+static inline int
+highest_bit (uint64_t mask) 
+{
+  uint32_t hi = mask >> 32;
+
+  ASSERT (mask != 0);
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else
+    return 31 - __builtin_clz ((uint32_t) mask);
+}
+
+/* Adds T to the back of the ready queue for its priority. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its ready queue. */
+static void
+ready_remove (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Removes and returns the thread at the front of the
+   highest-priority nonempty ready queue, which must exist. */
+static struct thread *
+ready_pop (void) 
+{
+  int pri = highest_bit (ready_mask);
+  struct list *queue = &ready_queues[pri];
+  struct thread *t = list_entry (list_pop_front (queue), struct thread, elem);
+
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << pri);
+  ready_cnt--;
+  return t;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_max_priority (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return ready_mask != 0 ? highest_bit (ready_mask) : PRI_MIN - 1;
+}
+
+/* Returns the priority that the multi-level feedback queue
+   scheduler assigns to T. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = PRI_MAX - fix_trunc (fix_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Multi-level feedback queue scheduler work for a timer tick
+   during which T was running.  Called in external interrupt
+   context.
+
+   Between per-second updates, only the running thread's
+   recent_cpu changes, so only its priority can change at each
+   PRIORITY_INTERVAL'th tick. */
+static void
+mlfqs_tick (struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+
+  if (t != idle_thread)
+    t->recent_cpu = fix_add_int (t->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    mlfqs_second ();
+
+  if (now % PRIORITY_INTERVAL == 0 && t != idle_thread)
+    {
+      t->priority = mlfqs_priority (t);
+      if (ready_max_priority () > t->priority)
+        intr_yield_on_return ();
+    }
+}
+
+/* Per-second update of the multi-level feedback queue scheduler:
+   updates the load average, decays recent_cpu of the running and
+   ready threads, and recomputes their priorities, moving ready
+   threads between queues as needed. */
+static void
+mlfqs_second (void) 
+{
+  struct thread *cur = running_thread ();
+  int running_cnt = ready_cnt + (cur != idle_thread ? 1 : 0);
+  fixed_t twice_load;
+  struct list ready;
+  int pri;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                      fix_mul_int (fix_frac (1, 60), running_cnt));
+  twice_load = fix_mul_int (load_avg, 2);
+  mlfqs_seconds++;
+  decay_history[mlfqs_seconds % DECAY_HISTORY]
+    = fix_div (twice_load, fix_add_int (twice_load, 1));
+
+  if (cur != idle_thread)
+    mlfqs_catch_up (cur);
+
+  /* Take every ready thread out of the queues, update it, and put
+     it back according to its new priority. */
+  list_init (&ready);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    if (!list_empty (&ready_queues[pri]))
+      list_splice (list_end (&ready), list_begin (&ready_queues[pri]),
+                   list_end (&ready_queues[pri]));
+  ready_mask = 0;
+  ready_cnt = 0;
+  while (!list_empty (&ready))
+    {
+      struct thread *t = list_entry (list_pop_front (&ready),
+                                     struct thread, elem);
+      mlfqs_catch_up (t);
+      ready_push (t);
+    }
+
+  if (ready_max_priority () > cur->priority)
+    intr_yield_on_return ();
+}
+
+/* Applies to T the recent_cpu decay of every per-second update
+   since T's last one, and recomputes T's priority accordingly.
+   T must not be in a ready queue.
+
+   A thread blocked for longer than DECAY_HISTORY seconds only
+   gets the most recent DECAY_HISTORY decays.  By then, recent_cpu
+   has converged to its long-run value to within a small
+   fraction, which the older decays would barely change. */
+static void
+mlfqs_catch_up (struct thread *t) 
+{
+  int64_t second = t->cpu_epoch;
+
+  if (mlfqs_seconds - second > DECAY_HISTORY)
+    second = mlfqs_seconds - DECAY_HISTORY;
+  while (second < mlfqs_seconds)
+    {
+      second++;
+      t->recent_cpu = fix_add_int (fix_mul (decay_history[second
+                                                          % DECAY_HISTORY],
+                                            t->recent_cpu),
+                                   t->nice);
+    }
+  t->cpu_epoch = mlfqs_seconds;
+  t->priority = mlfqs_priority (t);
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.  Among ready threads, the one with the highest
+   priority runs first, and threads of equal priority take turns
+   in round-robin order. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  if (ready_mask == 0)
     return idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_pop ();
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -533,6 +910,8 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  if (sched_trace_enabled && prev != NULL)
+    sched_trace_record (SCHED_SWITCH, cur);
 
   /* Start new time slice. */
   thread_ticks = 0;
@@ -572,6 +951,10 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Bring back the periodic tick before anyone else runs. */
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
@@ -4,6 +4,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +25,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -74,29 +80,56 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element in
+   the run queue (thread.c), an element in a semaphore wait list
+   (synch.c), or an element in the timer's sleep list (timer.c).
+   It can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list, and a thread blocked in
+   timer_sleep() is not waiting on any semaphore. */
 struct thread
   {
     /* Owned by thread.c. */
     tid_t tid;                          /* Thread identifier. */
     enum thread_status status;          /* Thread state. */
-    int64_t wakeup_time;                /* Time to wake up thread */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
+    int nice;                           /* Niceness (MLFQS). */
+    fixed_t recent_cpu;                 /* Recent CPU time (MLFQS). */
+    int64_t cpu_epoch;                  /* Second recent_cpu is as of. */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    /* Shared between thread.c and synch.c. */
+    /* Shared between thread.c, synch.c and timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Shared between thread.c and synch.c. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_time;                /* Tick to wake up at, if asleep. */
+
+    /* Owned by threads/sched-trace.c. */
+    uint64_t trace_ready_time;          /* When last made ready. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_code;                      /* Status to exit with. */
+    struct wait_status *wait_status;    /* Status shared with parent. */
+    struct list children;               /* Status of children. */
+    struct file *executable;            /* Running executable, write-denied. */
+
+    /* Owned by userprog/syscall.c. */
+    struct fd_table *fd_table;          /* Open file descriptors. */
+#endif
+
+#ifdef FILESYS
+    /* Shared between filesys/filesys.c and userprog/process.c. */
+    struct dir *cwd;                    /* Working directory, null for root. */
 #endif
 
     /* Owned by thread.c. */
@@ -111,8 +144,6 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void update_sleeping_threads(struct thread*, void*);
-
 void thread_tick (void);
 void thread_print_stats (void);
 
@@ -128,6 +159,10 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_yield_to_higher (void);
+void thread_change_priority (struct thread *, int priority);
+void thread_recompute_priority (struct thread *);
+void thread_mlfqs_refresh (struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
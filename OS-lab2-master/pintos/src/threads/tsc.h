@@ -0,0 +1,19 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Returns the CPU's time-stamp counter, which counts CPU cycles
+   since reset.  Reading it is cheap, so it suits timing short
+   stretches of code, far below the resolution of a timer tick. */
+static inline uint64_t
+read_tsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/tsc.h */
@@ -0,0 +1,149 @@
+#include "threads/work-queue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Kernel work queues.
+
+   A work queue runs short kernel tasks on a fixed pool of worker
+   threads, so that a burst of tasks does not pay for creating
+   and destroying a thread, with its page and its tid, for each
+   one.  Submitted work is kept in a FIFO list and started in
+   submission order, but since there are several workers, it may
+   finish in any order.
+
+   Work may block, for example on a lock or in timer_sleep(),
+   but while it does it keeps its worker busy.  Work that waits
+   for other work submitted to the same queue can therefore
+   deadlock if all of the workers end up waiting. */
+
+static void worker_loop (void *wq_) NO_RETURN;
+
+/* Initializes WQ and starts WORKER_CNT worker threads for it,
+   at the given PRIORITY, named after NAME.  Returns true if
+   successful, false if a worker thread could not be created, in
+   which case WQ is left destroyed. */
+bool
+work_queue_init (struct work_queue *wq, const char *name,
+                 size_t worker_cnt, int priority)
+{
+  size_t i;
+
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+  ASSERT (worker_cnt > 0);
+
+  lock_init (&wq->lock);
+  cond_init (&wq->not_empty);
+  list_init (&wq->pending);
+  wq->worker_cnt = 0;
+  wq->stopping = false;
+  sema_init (&wq->exited, 0);
+
+  for (i = 0; i < worker_cnt; i++)
+    {
+      char worker_name[16];
+
+      snprintf (worker_name, sizeof worker_name, "%s-%zu", name, i);
+      if (thread_create (worker_name, priority, worker_loop, wq) == TID_ERROR)
+        {
+          work_queue_destroy (wq);
+          return false;
+        }
+      wq->worker_cnt++;
+    }
+  return true;
+}
+
+/* Runs all of the work already submitted to WQ, then stops its
+   worker threads and waits for them to exit.  No more work may
+   be submitted to WQ afterward. */
+void
+work_queue_destroy (struct work_queue *wq)
+{
+  size_t i;
+
+  ASSERT (wq != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&wq->lock);
+  wq->stopping = true;
+  cond_broadcast (&wq->not_empty, &wq->lock);
+  lock_release (&wq->lock);
+
+  for (i = 0; i < wq->worker_cnt; i++)
+    sema_down (&wq->exited);
+  wq->worker_cnt = 0;
+}
+
+/* Initializes WORK to call FUNCTION, passing AUX. */
+void
+work_init (struct work *work, work_func *function, void *aux)
+{
+  ASSERT (work != NULL);
+  ASSERT (function != NULL);
+
+  work->function = function;
+  work->aux = aux;
+  sema_init (&work->done, 0);
+}
+
+/* Appends WORK to WQ's queue, to be run by the next free worker.
+   WORK must be initialized and not already queued.  This
+   function may sleep, so it must not be called from an
+   interrupt handler. */
+void
+work_submit (struct work_queue *wq, struct work *work)
+{
+  ASSERT (wq != NULL);
+  ASSERT (work != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&wq->lock);
+  ASSERT (!wq->stopping);
+  list_push_back (&wq->pending, &work->elem);
+  cond_signal (&wq->not_empty, &wq->lock);
+  lock_release (&wq->lock);
+}
+
+/* Waits until WORK, which must have been submitted, has run to
+   completion.  Only one thread may wait for a given WORK, once
+   per submission; afterward, WORK may be submitted again. */
+void
+work_wait (struct work *work)
+{
+  ASSERT (work != NULL);
+
+  sema_down (&work->done);
+}
+
+/* Worker thread.  Runs work from the work queue passed as
+   WQ_ until the queue is empty and being destroyed. */
+static void
+worker_loop (void *wq_)
+{
+  struct work_queue *wq = wq_;
+
+  for (;;)
+    {
+      struct work *work;
+
+      lock_acquire (&wq->lock);
+      while (list_empty (&wq->pending) && !wq->stopping)
+        cond_wait (&wq->not_empty, &wq->lock);
+      if (list_empty (&wq->pending))
+        {
+          lock_release (&wq->lock);
+          break;
+        }
+      work = list_entry (list_pop_front (&wq->pending), struct work, elem);
+      lock_release (&wq->lock);
+
+      work->function (work->aux);
+      sema_up (&work->done);
+    }
+
+  sema_up (&wq->exited);
+  thread_exit ();
+}
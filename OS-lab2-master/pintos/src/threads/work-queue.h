@@ -0,0 +1,44 @@
+#ifndef THREADS_WORK_QUEUE_H
+#define THREADS_WORK_QUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Function run by a worker thread for a unit of work. */
+typedef void work_func (void *aux);
+
+/* A unit of work.
+
+   The submitter owns the storage for a struct work, which must
+   stay valid until work_wait() returns for it. */
+struct work
+  {
+    struct list_elem elem;      /* Element in work_queue's pending list. */
+    work_func *function;        /* Function to run. */
+    void *aux;                  /* Argument to FUNCTION. */
+    struct semaphore done;      /* Upped when FUNCTION returns. */
+  };
+
+/* A fixed-size pool of worker threads that run submitted work
+   in submission order. */
+struct work_queue
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition not_empty; /* Signaled when work is submitted. */
+    struct list pending;        /* Work not yet started. */
+    size_t worker_cnt;          /* Number of worker threads. */
+    bool stopping;              /* Set by work_queue_destroy(). */
+    struct semaphore exited;    /* Upped by each exiting worker. */
+  };
+
+bool work_queue_init (struct work_queue *, const char *name,
+                      size_t worker_cnt, int priority);
+void work_queue_destroy (struct work_queue *);
+
+void work_init (struct work *, work_func *, void *aux);
+void work_submit (struct work_queue *, struct work *);
+void work_wait (struct work *);
+
+#endif /* threads/work-queue.h */
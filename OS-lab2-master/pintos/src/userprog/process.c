@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -14,55 +15,163 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
+/* What process_execute() passes to the new process's thread. */
+struct exec_info
+  {
+    uint8_t *stack_page;                /* The new process's stack. */
+    char *cmd_line;                     /* Command line, in STACK_PAGE. */
+    struct dir *cwd;                    /* Working directory to start in. */
+    struct semaphore loaded;            /* Upped when load is done. */
+    struct wait_status *wait_status;    /* Child's status, null on failure. */
+  };
+
+/* Status of a child process, shared between the child and its
+   parent.  The child reports its exit code here and ups DEAD, and
+   the parent downs DEAD to wait for it.  Whichever of the two is
+   done with the record last frees it. */
+struct wait_status
+  {
+    struct list_elem elem;              /* Element in parent's children. */
+    struct lock lock;                   /* Protects REF_CNT. */
+    int ref_cnt;                        /* Number of holders, 0 to 2. */
+    tid_t tid;                          /* Child's thread id. */
+    int exit_code;                      /* Child's exit code, once dead. */
+    struct semaphore dead;              /* Upped when child exits. */
+  };
+
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool load (char *cmd_line, uint8_t *stack_page,
+                  void (**eip) (void), void **esp);
+static void release_status (struct wait_status *);
+
+/* Starts a new thread running a user program loaded from the
+   first word of CMD_LINE, with the words of CMD_LINE as its
+   arguments.  Returns the new process's thread id once it has
+   loaded, or TID_ERROR if the thread cannot be created or the
+   program cannot be loaded. */
+tid_t
+process_execute (const char *cmd_line) 
+{
+  uint8_t *stack_page;
+  char *copy;
+  size_t length;
+
+  /* The command line must fit in the new process's stack page,
+     along with at least its terminator. */
+  length = strnlen (cmd_line, PGSIZE);
+  if (length >= PGSIZE)
+    return TID_ERROR;
+
+  /* Copy CMD_LINE to the top of the page that will become the
+     new process's stack.  Otherwise there's a race between the
+     caller and load().  The copy is tokenized where it lies, so
+     this is the only copy made of it. */
+  stack_page = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (stack_page == NULL)
+    return TID_ERROR;
+  copy = (char *) stack_page + PGSIZE - (length + 1);
+  memcpy (copy, cmd_line, length + 1);
+  return process_execute_page (stack_page, copy);
+}
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Like process_execute(), but for a command line CMD_LINE that
+   has already been copied to the top of STACK_PAGE, a page
+   obtained with palloc_get_page (PAL_USER | PAL_ZERO).  Takes
+   ownership of STACK_PAGE.  The exec system call copies the
+   command line there straight from user memory. */
 tid_t
-process_execute (const char *file_name) 
+process_execute_page (uint8_t *stack_page, char *cmd_line)
 {
-  char *fn_copy;
+  struct thread *cur = thread_current ();
+  struct exec_info info;
+  char name[16];
+  size_t i;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  info.stack_page = stack_page;
+  info.cmd_line = cmd_line;
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  /* The new process starts in our working directory. */
+  info.cwd = cur->cwd != NULL ? dir_reopen (cur->cwd) : NULL;
+  if (cur->cwd != NULL && info.cwd == NULL)
+    {
+      palloc_free_page (info.stack_page);
+      return TID_ERROR;
+    }
+  sema_init (&info.loaded, 0);
+
+  /* Name the new thread after the program it runs. */
+  cmd_line += strspn (cmd_line, " ");
+  for (i = 0; i < sizeof name - 1 && cmd_line[i] != '\0'
+              && cmd_line[i] != ' '; i++)
+    name[i] = cmd_line[i];
+  name[i] = '\0';
+
+  /* Create a new thread to execute CMD_LINE, and wait for it to
+     load.  INFO is on our stack, so the new thread must be done
+     with it by the time it ups INFO.LOADED. */
+  tid = thread_create (name, PRI_DEFAULT, start_process, &info);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    {
+      dir_close (info.cwd);
+      palloc_free_page (info.stack_page); 
+      return TID_ERROR;
+    }
+  sema_down (&info.loaded);
+  if (info.wait_status == NULL)
+    return TID_ERROR;
+  list_push_back (&cur->children, &info.wait_status->elem);
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-  char *file_name = file_name_;
+  struct exec_info *info = info_;
+  struct thread *cur = thread_current ();
   struct intr_frame if_;
   bool success;
 
+  cur->cwd = info->cwd;
+  cur->exit_code = -1;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (info->cmd_line, info->stack_page, &if_.eip, &if_.esp);
+
+  /* Create the status record to share with our parent. */
+  if (success)
+    {
+      cur->wait_status = malloc (sizeof *cur->wait_status);
+      success = cur->wait_status != NULL;
+    }
+  if (success)
+    {
+      struct wait_status *ws = cur->wait_status;
+      lock_init (&ws->lock);
+      ws->ref_cnt = 2;
+      ws->tid = cur->tid;
+      ws->exit_code = -1;
+      sema_init (&ws->dead, 0);
+    }
+
+  /* Tell our parent how the load went.  INFO may not be used
+     after this. */
+  info->wait_status = cur->wait_status;
+  sema_up (&info->loaded);
 
   /* If load failed, quit. */
-  palloc_free_page (file_name);
   if (!success) 
     thread_exit ();
 
@@ -76,18 +185,47 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Drops a reference to WS, freeing it if no references
+   remain. */
+static void
+release_status (struct wait_status *ws)
+{
+  int new_ref_cnt;
+
+  lock_acquire (&ws->lock);
+  new_ref_cnt = --ws->ref_cnt;
+  lock_release (&ws->lock);
+  if (new_ref_cnt == 0)
+    free (ws);
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct wait_status *ws = list_entry (e, struct wait_status, elem);
+      if (ws->tid == child_tid)
+        {
+          int exit_code;
+
+          list_remove (e);
+          sema_down (&ws->dead);
+          exit_code = ws->exit_code;
+          release_status (ws);
+          return exit_code;
+        }
+    }
   return -1;
 }
 
@@ -96,8 +234,38 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
   uint32_t *pd;
 
+  if (cur->pagedir != NULL)
+    printf ("%s: exit(%d)\n", cur->name, cur->exit_code);
+
+  /* Report our exit code to our parent. */
+  if (cur->wait_status != NULL)
+    {
+      struct wait_status *ws = cur->wait_status;
+      ws->exit_code = cur->exit_code;
+      sema_up (&ws->dead);
+      release_status (ws);
+      cur->wait_status = NULL;
+    }
+
+  /* Give up our children's status records. */
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = next)
+    {
+      next = list_remove (e);
+      release_status (list_entry (e, struct wait_status, elem));
+    }
+
+  syscall_exit ();
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+
+  /* Allow writes to our executable again. */
+  file_close (cur->executable);
+  cur->executable = NULL;
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -195,26 +363,41 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static int split_args (char *cmd_line);
+static bool setup_stack (uint8_t *stack_page, const char *cmd_line, int argc,
+                         void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads an ELF executable named by the first word of CMD_LINE
+   into the current thread, with a stack in STACK_PAGE that holds
+   CMD_LINE's words as arguments.  CMD_LINE must lie at the top
+   of STACK_PAGE, which load() takes ownership of.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (char *cmd_line, uint8_t *stack_page, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
+  const char *file_name;
   off_t file_ofs;
   bool success = false;
+  int argc;
   int i;
 
+  /* Split the command line into words.  The program name is the
+     first one. */
+  argc = split_args (cmd_line);
+  if (argc == 0)
+    goto done;
+  for (file_name = cmd_line; *file_name == '\0'; file_name++)
+    continue;
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
@@ -228,6 +411,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  file_deny_write (file);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -302,8 +486,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   /* Set up stack. */
-  if (!setup_stack (esp))
+  if (!setup_stack (stack_page, cmd_line, argc, esp))
     goto done;
+  stack_page = NULL;
 
   /* Start address. */
   *eip = (void (*) (void)) ehdr.e_entry;
@@ -312,9 +497,32 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
  done:
   /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  if (stack_page != NULL)
+    palloc_free_page (stack_page);
+  if (success)
+    t->executable = file;
+  else
+    file_close (file);
   return success;
 }
+
+/* Splits CMD_LINE into words in place, by replacing every space
+   with a null character, and returns the number of words.  A word
+   then starts at each non-null character that follows a null
+   character or the start of CMD_LINE. */
+static int
+split_args (char *cmd_line)
+{
+  int argc = 0;
+  char *p;
+
+  for (p = cmd_line; *p != '\0'; p++)
+    if (*p == ' ')
+      *p = '\0';
+    else if (p == cmd_line || p[-1] == '\0')
+      argc++;
+  return argc;
+}
 
 /* load() helpers. */
 
@@ -424,24 +632,47 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Create a stack by mapping STACK_PAGE at the top of user
+   virtual memory.  The ARGC words of CMD_LINE, as split by
+   split_args(), already lie at the top of STACK_PAGE, so the
+   argument strings stay where they are and only argv, argc and a
+   fake return address are pushed below them. */
 static bool
-setup_stack (void **esp) 
+setup_stack (uint8_t *stack_page, const char *cmd_line, int argc,
+             void **esp) 
 {
-  uint8_t *kpage;
-  bool success = false;
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  const char *end = (const char *) stack_page + PGSIZE;
+  const char *p;
+  uint32_t *sp;
+  char **argv;
+  int i;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
-    }
-  return success;
+  /* Make room for argv and its null terminator, a pointer to
+     argv, argc, and the return address, below the word-aligned
+     strings. */
+  sp = (uint32_t *) ((uintptr_t) cmd_line & ~(uintptr_t) 3);
+  if ((uint8_t *) sp - stack_page < (argc + 4) * (int) sizeof *sp)
+    return false;
+  sp -= argc + 1;
+  argv = (char **) sp;
+
+  /* Point argv at each word, as a user address. */
+  i = 0;
+  for (p = cmd_line; p < end; p++)
+    if (*p != '\0' && (p == cmd_line || p[-1] == '\0'))
+      argv[i++] = (char *) upage + (p - (const char *) stack_page);
+  ASSERT (i == argc);
+  argv[argc] = NULL;
+
+  *--sp = (uintptr_t) upage + ((uint8_t *) argv - stack_page);
+  *--sp = argc;
+  *--sp = 0;
+
+  if (!install_page (upage, stack_page, true))
+    return false;
+  *esp = upage + ((uint8_t *) sp - stack_page);
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
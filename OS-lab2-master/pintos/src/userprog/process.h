@@ -3,7 +3,8 @@
 
 #include "threads/thread.h"
 
-tid_t process_execute (const char *file_name);
+tid_t process_execute (const char *cmd_line);
+tid_t process_execute_page (uint8_t *stack_page, char *cmd_line);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
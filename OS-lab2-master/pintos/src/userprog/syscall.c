@@ -1,20 +1,790 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "userprog/process.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A system call handler.  Takes the call's arguments as ARGS, an
+   array of 32-bit words copied from the user stack, decodes them
+   itself, and returns the value to put in the caller's EAX. */
+typedef int syscall_function (const uint32_t args[]);
+
+/* A system call. */
+struct syscall
+  {
+    size_t arg_cnt;                     /* Number of arguments. */
+    syscall_function *func;             /* Implementation. */
+  };
+
+/* An open file descriptor.  Exactly one of FILE and DIR is
+   nonnull.  Descriptors made by dup share the same FILE or DIR,
+   and so its position, each holding a reference to it. */
+struct fd
+  {
+    struct file *file;                  /* Open file. */
+    struct dir *dir;                    /* Open directory. */
+  };
+
+/* A process's file descriptor table.
+
+   Descriptors 0 and 1 are the console, and descriptor FD_BASE + I
+   is slot I in the table.  A bitmap marks the slots in use, so
+   that a descriptor is found by indexing the array and a free one
+   by scanning the bitmap a word at a time.  The table is created
+   on the first open, and doubles in size whenever it fills up. */
+struct fd_table
+  {
+    struct fd *fds;                     /* Slots. */
+    struct bitmap *used;                /* Slots in use. */
+    size_t slot_cnt;                    /* Number of slots. */
+  };
+
+/* A buffer passed to readv or writev, laid out as in
+   lib/user/syscall.h. */
+struct iovec
+  {
+    void *iov_base;                     /* Start of buffer. */
+    size_t iov_len;                     /* Length of buffer in bytes. */
+  };
+
+/* Maximum number of buffers passed to readv or writev. */
+#define IOV_MAX 16
+
+/* Descriptor for the first slot. */
+#define FD_BASE 2
+
+/* Number of slots in a new table. */
+#define FD_INIT_CNT 16
+
+static int alloc_fd (struct file *, struct dir *);
+static struct fd *lookup_fd (int fd);
+static bool grow_table (struct fd_table *);
+
+static syscall_function sys_halt;
+static syscall_function sys_exit;
+static syscall_function sys_exec;
+static syscall_function sys_wait;
+static syscall_function sys_create;
+static syscall_function sys_remove;
+static syscall_function sys_open;
+static syscall_function sys_filesize;
+static syscall_function sys_read;
+static syscall_function sys_write;
+static syscall_function sys_seek;
+static syscall_function sys_tell;
+static syscall_function sys_close;
+static syscall_function sys_chdir;
+static syscall_function sys_mkdir;
+static syscall_function sys_readdir;
+static syscall_function sys_isdir;
+static syscall_function sys_inumber;
+static syscall_function sys_readv;
+static syscall_function sys_writev;
+static syscall_function sys_copy_file_range;
+static syscall_function sys_dup;
+static int read_fd (int fd, void *ubuffer, unsigned size);
+static int write_fd (int fd, const void *ubuffer, unsigned size);
+
+/* Table of system calls, indexed by number.  Calls without an
+   entry kill the process that makes them. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {0, sys_halt},
+    [SYS_EXIT] = {1, sys_exit},
+    [SYS_EXEC] = {1, sys_exec},
+    [SYS_WAIT] = {1, sys_wait},
+    [SYS_CREATE] = {2, sys_create},
+    [SYS_REMOVE] = {1, sys_remove},
+    [SYS_OPEN] = {1, sys_open},
+    [SYS_FILESIZE] = {1, sys_filesize},
+    [SYS_READ] = {3, sys_read},
+    [SYS_WRITE] = {3, sys_write},
+    [SYS_SEEK] = {2, sys_seek},
+    [SYS_TELL] = {1, sys_tell},
+    [SYS_CLOSE] = {1, sys_close},
+    [SYS_CHDIR] = {1, sys_chdir},
+    [SYS_MKDIR] = {1, sys_mkdir},
+    [SYS_READDIR] = {2, sys_readdir},
+    [SYS_ISDIR] = {1, sys_isdir},
+    [SYS_INUMBER] = {1, sys_inumber},
+    [SYS_READV] = {3, sys_readv},
+    [SYS_WRITEV] = {3, sys_writev},
+    [SYS_COPY_FILE_RANGE] = {3, sys_copy_file_range},
+    [SYS_DUP] = {1, sys_dup},
+  };
 
 static void syscall_handler (struct intr_frame *);
+static void copy_in (void *, const void *usrc, size_t);
+static char *copy_in_string (const char *us);
+static size_t strlen_user (const char *us);
+static void verify_user (const void *uaddr, size_t size, bool writable);
+static inline bool get_user (uint8_t *dst, const uint8_t *usrc);
+static inline bool put_user (uint8_t *udst, uint8_t byte);
 
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* Closes all of the running process's file descriptors and frees
+   its descriptor table. */
+void
+syscall_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct fd_table *table = cur->fd_table;
+  size_t slot;
+
+  if (table == NULL)
+    return;
+
+  for (slot = 0; slot < table->slot_cnt; slot++)
+    if (bitmap_test (table->used, slot))
+      {
+        file_close (table->fds[slot].file);
+        dir_close (table->fds[slot].dir);
+      }
+  bitmap_destroy (table->used);
+  free (table->fds);
+  free (table);
+  cur->fd_table = NULL;
+}
+
+/* Adds FILE or DIR, whichever is nonnull, to the running
+   process's descriptor table, which takes ownership of it.
+   Returns the new descriptor, or -1 if memory is not available,
+   in which case FILE and DIR are closed. */
+static int
+alloc_fd (struct file *file, struct dir *dir)
+{
+  struct thread *cur = thread_current ();
+  struct fd_table *table = cur->fd_table;
+  size_t slot;
+
+  if (table == NULL)
+    {
+      table = malloc (sizeof *table);
+      if (table == NULL)
+        goto error;
+      table->fds = malloc (FD_INIT_CNT * sizeof *table->fds);
+      table->used = bitmap_create (FD_INIT_CNT);
+      table->slot_cnt = FD_INIT_CNT;
+      if (table->fds == NULL || table->used == NULL)
+        {
+          free (table->fds);
+          if (table->used != NULL)
+            bitmap_destroy (table->used);
+          free (table);
+          goto error;
+        }
+      cur->fd_table = table;
+    }
+
+  slot = bitmap_scan_and_flip (table->used, 0, 1, false);
+  if (slot == BITMAP_ERROR)
+    {
+      slot = table->slot_cnt;
+      if (!grow_table (table))
+        goto error;
+      bitmap_mark (table->used, slot);
+    }
+  table->fds[slot].file = file;
+  table->fds[slot].dir = dir;
+  return slot + FD_BASE;
+
+ error:
+  file_close (file);
+  dir_close (dir);
+  return -1;
+}
+
+/* Doubles the number of slots in TABLE, all of which must be in
+   use.  Returns true if successful, false if memory is not
+   available. */
+static bool
+grow_table (struct fd_table *table)
+{
+  size_t new_cnt = table->slot_cnt * 2;
+  struct bitmap *used;
+  struct fd *fds;
+
+  used = bitmap_create (new_cnt);
+  if (used == NULL)
+    return false;
+  fds = realloc (table->fds, new_cnt * sizeof *fds);
+  if (fds == NULL)
+    {
+      bitmap_destroy (used);
+      return false;
+    }
+
+  bitmap_set_multiple (used, 0, table->slot_cnt, true);
+  bitmap_destroy (table->used);
+  table->fds = fds;
+  table->used = used;
+  table->slot_cnt = new_cnt;
+  return true;
+}
+
+/* Returns the running process's open descriptor FD, or a null
+   pointer if FD is not open. */
+static struct fd *
+lookup_fd (int fd)
+{
+  struct fd_table *table = thread_current ()->fd_table;
+  size_t slot = fd - FD_BASE;
+
+  if (table == NULL || fd < FD_BASE || slot >= table->slot_cnt
+      || !bitmap_test (table->used, slot))
+    return NULL;
+  return &table->fds[slot];
+}
+
+/* System call handler.  Looks up the call whose number is on top
+   of the user stack, copies in as many arguments as it takes, and
+   calls it. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  const struct syscall *sc;
+  unsigned call_nr;
+  uint32_t args[3];
+
+  copy_in (&call_nr, f->esp, sizeof call_nr);
+  if (call_nr >= sizeof syscall_table / sizeof *syscall_table
+      || syscall_table[call_nr].func == NULL)
+    thread_exit ();
+  sc = &syscall_table[call_nr];
+
+  ASSERT (sc->arg_cnt <= sizeof args / sizeof *args);
+  memset (args, 0, sizeof args);
+  copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * sc->arg_cnt);
+
+  f->eax = sc->func (args);
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Kills the process if any of the user bytes is not
+   accessible. */
+static void
+copy_in (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  for (; size > 0; size--, dst++, usrc++)
+    if (usrc >= (uint8_t *) PHYS_BASE || !get_user (dst, usrc))
+      thread_exit ();
+}
+
+/* Copies the null-terminated string at user address US into a
+   new page and returns it.  The caller must free the page with
+   palloc_free_page().  Kills the process if the string is not
+   accessible or does not fit in a page, or if no page is
+   available. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    thread_exit ();
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      if (us + length >= (char *) PHYS_BASE
+          || !get_user ((uint8_t *) ks + length, (uint8_t *) us + length))
+        break;
+      if (ks[length] == '\0')
+        return ks;
+    }
+  palloc_free_page (ks);
+  thread_exit ();
+}
+
+/* Returns the length of the null-terminated string at user
+   address US.  Kills the process if the string is not accessible
+   or does not fit in a page. */
+static size_t
+strlen_user (const char *us)
+{
+  size_t length;
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      uint8_t byte;
+
+      if (us + length >= (char *) PHYS_BASE
+          || !get_user (&byte, (uint8_t *) us + length))
+        break;
+      if (byte == '\0')
+        return length;
+    }
+  thread_exit ();
+}
+
+/* Checks that the SIZE bytes at user address UADDR are mapped,
+   and writable if WRITABLE is true, killing the process if not.
+   Touches one byte in each page rather than checking every byte,
+   after which the buffer may be accessed in place. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+verify_user (const void *uaddr, size_t size, bool writable)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0)
+    return;
+  if (end < p || end > (uint8_t *) PHYS_BASE)
+    thread_exit ();
+
+  for (p = pg_round_down (p); p < end; p += PGSIZE)
+    {
+      const uint8_t *q = p < (uint8_t *) uaddr ? uaddr : p;
+      uint8_t byte;
+
+      if (!get_user (&byte, q)
+          || (writable && !put_user ((uint8_t *) q, byte)))
+        thread_exit ();
+    }
+}
+
+/* Reads a byte at user virtual address USRC, which must be below
+   PHYS_BASE, into *DST.  Returns true if successful, false if a
+   segfault occurred, in which case page_fault() resumes at the
+   address this code left in EAX and sets EAX to 0. */
+static inline bool
+get_user (uint8_t *dst, const uint8_t *usrc)
 {
-  printf ("system call!\n");
+  int eax;
+  asm ("movl $1f, %%eax; movb %2, %%al; movb %%al, %0; 1:"
+       : "=m" (*dst), "=&a" (eax) : "m" (*usrc));
+  return eax != 0;
+}
+
+/* Writes BYTE to user virtual address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a segfault
+   occurred. */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int eax;
+  asm ("movl $1f, %%eax; movb %b2, %0; 1:"
+       : "=m" (*udst), "=&a" (eax) : "q" (byte));
+  return eax != 0;
+}
+
+/* Halt system call. */
+static int
+sys_halt (const uint32_t *args UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Exit system call. */
+static int
+sys_exit (const uint32_t *args)
+{
+  int status = args[0];
+
+  thread_current ()->exit_code = status;
   thread_exit ();
+  NOT_REACHED ();
+}
+
+/* Exec system call.  Copies the command line from user memory
+   straight to the top of the page that becomes the new process's
+   stack, so that it is copied only once. */
+static int
+sys_exec (const uint32_t *args)
+{
+  const char *ucmd_line = (const char *) args[0];
+  size_t length = strlen_user (ucmd_line);
+  uint8_t *stack_page;
+  char *cmd_line;
+
+  stack_page = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (stack_page == NULL)
+    return TID_ERROR;
+  cmd_line = (char *) stack_page + PGSIZE - (length + 1);
+  copy_in (cmd_line, ucmd_line, length + 1);
+  return process_execute_page (stack_page, cmd_line);
+}
+
+/* Wait system call. */
+static int
+sys_wait (const uint32_t *args)
+{
+  tid_t child = args[0];
+
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (const uint32_t *args)
+{
+  const char *ufile = (const char *) args[0];
+  unsigned initial_size = args[1];
+  char *kfile = copy_in_string (ufile);
+  bool ok = filesys_create (kfile, initial_size);
+
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (const uint32_t *args)
+{
+  const char *ufile = (const char *) args[0];
+  char *kfile = copy_in_string (ufile);
+  bool ok = filesys_remove (kfile);
+
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Open system call. */
+static int
+sys_open (const uint32_t *args)
+{
+  const char *ufile = (const char *) args[0];
+  char *kfile = copy_in_string (ufile);
+  struct file *file = filesys_open (kfile);
+  struct inode *inode;
+
+  palloc_free_page (kfile);
+  if (file == NULL)
+    return -1;
+
+  /* Directories are kept open as directories, so that readdir
+     has a position to read from. */
+  inode = file_get_inode (file);
+  if (inode_is_dir (inode))
+    {
+      struct dir *dir = dir_open (inode_reopen (inode));
+      file_close (file);
+      return dir != NULL ? alloc_fd (NULL, dir) : -1;
+    }
+  return alloc_fd (file, NULL);
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  if (d == NULL || d->file == NULL)
+    return -1;
+  return file_length (d->file);
+}
+
+/* Read system call. */
+static int
+sys_read (const uint32_t *args)
+{
+  return read_fd (args[0], (void *) args[1], args[2]);
+}
+
+/* Reads SIZE bytes from FD into user buffer UBUFFER, for read and
+   readv.  Returns the number of bytes read, or -1 if FD is not
+   open for reading. */
+static int
+read_fd (int fd, void *ubuffer, unsigned size)
+{
+  struct fd *d;
+
+  verify_user (ubuffer, size, true);
+  if (fd == STDIN_FILENO)
+    {
+      uint8_t *udst = ubuffer;
+      unsigned i;
+
+      for (i = 0; i < size; i++)
+        udst[i] = input_getc ();
+      return size;
+    }
+
+  d = lookup_fd (fd);
+  if (d == NULL || d->file == NULL)
+    return -1;
+  return file_read (d->file, ubuffer, size);
+}
+
+/* Write system call. */
+static int
+sys_write (const uint32_t *args)
+{
+  return write_fd (args[0], (const void *) args[1], args[2]);
+}
+
+/* Writes SIZE bytes from user buffer UBUFFER to FD, for write and
+   writev.  Returns the number of bytes written, or -1 if FD is
+   not open for writing. */
+static int
+write_fd (int fd, const void *ubuffer, unsigned size)
+{
+  struct fd *d;
+
+  verify_user (ubuffer, size, false);
+  if (fd == STDOUT_FILENO)
+    {
+      putbuf (ubuffer, size);
+      return size;
+    }
+
+  d = lookup_fd (fd);
+  if (d == NULL || d->file == NULL)
+    return -1;
+  return file_write (d->file, ubuffer, size);
+}
+
+/* Seek system call. */
+static int
+sys_seek (const uint32_t *args)
+{
+  int fd = args[0];
+  unsigned position = args[1];
+  struct fd *d = lookup_fd (fd);
+
+  if (d != NULL && d->file != NULL && (off_t) position >= 0)
+    file_seek (d->file, position);
+  return 0;
+}
+
+/* Tell system call. */
+static int
+sys_tell (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  if (d == NULL || d->file == NULL)
+    return -1;
+  return file_tell (d->file);
+}
+
+/* Close system call. */
+static int
+sys_close (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  if (d != NULL)
+    {
+      file_close (d->file);
+      dir_close (d->dir);
+      bitmap_reset (thread_current ()->fd_table->used, fd - FD_BASE);
+    }
+  return 0;
+}
+
+/* Chdir system call. */
+static int
+sys_chdir (const uint32_t *args)
+{
+  const char *udir = (const char *) args[0];
+  char *kdir = copy_in_string (udir);
+  bool ok = filesys_chdir (kdir);
+
+  palloc_free_page (kdir);
+  return ok;
+}
+
+/* Mkdir system call. */
+static int
+sys_mkdir (const uint32_t *args)
+{
+  const char *udir = (const char *) args[0];
+  char *kdir = copy_in_string (udir);
+  bool ok = filesys_mkdir (kdir);
+
+  palloc_free_page (kdir);
+  return ok;
+}
+
+/* Readdir system call. */
+static int
+sys_readdir (const uint32_t *args)
+{
+  int fd = args[0];
+  char *uname = (char *) args[1];
+  struct fd *d = lookup_fd (fd);
+
+  verify_user (uname, NAME_MAX + 1, true);
+  if (d == NULL || d->dir == NULL)
+    return false;
+  return dir_readdir (d->dir, uname);
+}
+
+/* Isdir system call. */
+static int
+sys_isdir (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  return d != NULL && d->dir != NULL;
+}
+
+/* Inumber system call. */
+static int
+sys_inumber (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  if (d == NULL)
+    return -1;
+  return inode_get_inumber (d->file != NULL
+                            ? file_get_inode (d->file)
+                            : dir_get_inode (d->dir));
+}
+
+/* Readv system call.  Reads into each buffer in turn, stopping
+   at the first short read. */
+static int
+sys_readv (const uint32_t *args)
+{
+  int fd = args[0];
+  const struct iovec *uiov = (const struct iovec *) args[1];
+  int iovcnt = args[2];
+  struct iovec iov[IOV_MAX];
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  copy_in (iov, uiov, iovcnt * sizeof *iov);
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      int n = read_fd (fd, iov[i].iov_base, iov[i].iov_len);
+      if (n < 0)
+        return i > 0 ? total : -1;
+      total += n;
+      if ((size_t) n < iov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Writev system call.  Writes from each buffer in turn, stopping
+   at the first short write. */
+static int
+sys_writev (const uint32_t *args)
+{
+  int fd = args[0];
+  const struct iovec *uiov = (const struct iovec *) args[1];
+  int iovcnt = args[2];
+  struct iovec iov[IOV_MAX];
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  copy_in (iov, uiov, iovcnt * sizeof *iov);
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      int n = write_fd (fd, iov[i].iov_base, iov[i].iov_len);
+      if (n < 0)
+        return i > 0 ? total : -1;
+      total += n;
+      if ((size_t) n < iov[i].iov_len)
+        break;
+    }
+  return total;
+}
+
+/* Copy_file_range system call.  Copies up to LENGTH bytes from
+   the current position in FD_IN to the current position in
+   FD_OUT, which may also be the console, a page at a time through
+   a kernel buffer.  Returns the number of bytes copied, which is
+   less than LENGTH only at end of file or on a short write. */
+static int
+sys_copy_file_range (const uint32_t *args)
+{
+  int fd_in = args[0];
+  int fd_out = args[1];
+  unsigned length = args[2];
+  struct fd *in = lookup_fd (fd_in);
+  struct fd *out = NULL;
+  uint8_t *buffer;
+  int copied = 0;
+
+  if (in == NULL || in->file == NULL)
+    return -1;
+  if (fd_out != STDOUT_FILENO)
+    {
+      out = lookup_fd (fd_out);
+      if (out == NULL || out->file == NULL)
+        return -1;
+    }
+  if (length > INT_MAX)
+    length = INT_MAX;
+
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return -1;
+  while ((unsigned) copied < length)
+    {
+      off_t chunk = length - copied < PGSIZE ? length - copied : PGSIZE;
+      off_t bytes_read = file_read (in->file, buffer, chunk);
+      off_t bytes_written;
+
+      if (bytes_read <= 0)
+        break;
+      if (out != NULL)
+        bytes_written = file_write (out->file, buffer, bytes_read);
+      else
+        {
+          putbuf ((char *) buffer, bytes_read);
+          bytes_written = bytes_read;
+        }
+      copied += bytes_written;
+
+      /* Leave FD_IN just past the bytes that were copied. */
+      if (bytes_written < bytes_read)
+        {
+          file_seek (in->file,
+                     file_tell (in->file) - (bytes_read - bytes_written));
+          break;
+        }
+    }
+  palloc_free_page (buffer);
+  return copied;
+}
+
+/* Dup system call.  The new descriptor shares FD's open file or
+   directory, including its position. */
+static int
+sys_dup (const uint32_t *args)
+{
+  int fd = args[0];
+  struct fd *d = lookup_fd (fd);
+
+  if (d == NULL)
+    return -1;
+  return alloc_fd (file_dup (d->file), dir_dup (d->dir));
 }